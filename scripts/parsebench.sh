@@ -0,0 +1,50 @@
+#!/usr/bin/env sh
+#
+# Compare the parser.style settings (recursive, trampoline and table) for a
+# grammar - compile time, binary size and the run time of the generated
+# program.
+#
+# usage: parsebench.sh [grammar.yalr [args for the program...]]
+#
+# The grammar must not set parser.style itself, and needs a main() (e.g.
+# examples/parsebench.yalr, the default, or option code.main true;).
+#
+
+YALR=${YALR:-build/yalr}
+CXX=${CXX:-c++}
+CXXFLAGS=${CXXFLAGS:-"-std=c++17 -O2 -DNDEBUG"}
+
+GRAMMAR=${1:-examples/parsebench.yalr}
+[ $# -gt 0 ] && shift
+
+WORK=$(mktemp -d) || exit 1
+trap 'rm -rf "$WORK"' EXIT
+
+now() {
+    date +%s.%N
+}
+
+elapsed() {
+    awk "BEGIN { print $2 - $1 }"
+}
+
+printf "%-10s %12s %12s\n" style "compile s" "size bytes"
+for style in recursive trampoline table; do
+    { cat "$GRAMMAR"; echo; echo "option parser.style $style;"; } > "$WORK/$style.yalr"
+    "$YALR" -o "$WORK/$style.cpp" "$WORK/$style.yalr" > /dev/null || exit 1
+
+    start=$(now)
+    $CXX $CXXFLAGS -pthread -o "$WORK/$style" "$WORK/$style.cpp" || exit 1
+    end=$(now)
+
+    size=$(wc -c < "$WORK/$style")
+    printf "%-10s %12.2f %12d\n" $style $(elapsed $start $end) $size
+done
+
+for style in recursive trampoline table; do
+    echo "--- $style"
+    start=$(now)
+    "$WORK/$style" "$@"
+    end=$(now)
+    echo "run time $(elapsed $start $end) s"
+done
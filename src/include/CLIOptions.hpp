@@ -9,6 +9,8 @@ struct CLIOptions {
     std::string state_file;
     std::string input_file;
     bool debug = false;
+    bool strict_linear = false;
+    bool pattern_report = false;
     bool help = false;
 };
 
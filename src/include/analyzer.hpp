@@ -6,7 +6,15 @@
 
 namespace yalr::analyzer {
 
-    std::unique_ptr<yalr::analyzer_tree> analyze(const yalr::parse_tree &tree);
+    //
+    // With strict_linear, it is an error for any pattern to need std::regex,
+    // since it can't be promised to match in linear time.
+    //
+    std::unique_ptr<yalr::analyzer_tree> analyze(const yalr::parse_tree &tree,
+            bool strict_linear = false);
+
+    // How each term and skip will be matched, and what could go wrong.
+    void pattern_report(const yalr::analyzer_tree &tree, std::ostream& strm);
 
     void pretty_print(const yalr::analyzer_tree &tree, std::ostream& strm);
 
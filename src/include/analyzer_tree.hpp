@@ -31,6 +31,11 @@ extern std::unordered_set<std::string_view> verbatim_locations;
             return errors.add(util::concat(args...), tf);
         }
 
+        template <class ...Args>
+        error_info & record_warning(const text_fragment tf, Args&&... args) {
+            return errors.add(util::concat(args...), tf, message_type::warning);
+        }
+
         operator bool() const { return success; }
     };
 
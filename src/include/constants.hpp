@@ -32,6 +32,27 @@ namespace yalr {
         undef, string, regex
     };
 
+    //
+    // How the generated lexer matches patterns
+    //
+    enum class lexer_engine_type {
+        undef, dfa, lazy, regex
+    };
+
+    //
+    // How the generated parser runs the LR states
+    //
+    enum class parser_style_type {
+        undef, recursive, table, trampoline
+    };
+
+    //
+    // How the lexeme is handed to terminal actions
+    //
+    enum class lexeme_type {
+        undef, string, view
+    };
+
     //
     // Actions in the lrtable
     //
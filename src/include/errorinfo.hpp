@@ -32,6 +32,9 @@ namespace yalr {
 
         int size() const { return static_cast<int>(errors.size()); }
 
+        // Just the errors - not warnings or info.
+        int error_count() const;
+
         std::ostream& output(std::ostream &strm) const;
     };
 
@@ -0,0 +1,252 @@
+#if not defined(YALR_LEXGEN_HPP)
+#define YALR_LEXGEN_HPP
+
+#include "constants.hpp"
+#include "regex_tree.hpp"
+
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace yalr {
+
+    //
+    // One term or skip as seen by the lexer generator. The index of the
+    // pattern in the vector passed to generate_lexer_tables() is its
+    // priority - lower wins when two patterns match the same length.
+    //
+    struct lexer_pattern {
+        std::string_view pattern;
+        pattern_type     pat_type;
+        case_type        case_match;
+        bool             is_skip = false;
+    };
+
+    //
+    // Hand written matchers for the common shapes of skip pattern.
+    //
+    // run    - [body]+                        e.g. \s+
+    // line   - prefix [body]* terminator?     e.g. --.*\n
+    //          (the terminator is at most one byte and not in body)
+    // block  - prefix [body]*? terminator     e.g. /\*(?:.|\n)*?\*/
+    // quoted - prefix (?:[body]|escape[escaped])* terminator
+    //                                         e.g. "(?:[^"\\]|\\.)*"
+    //          (the terminator is one byte. Neither it nor the escape is
+    //          in body. The repeat may also be non-greedy, in which case
+    //          the terminator may be in body.)
+    //
+    // Terms whose pattern has one of the delimited shapes (anything but
+    // run) use the scanners as well.
+    //
+    enum class scanner_type { run, line, block, quoted };
+
+    struct skip_scanner {
+        scanner_type type;
+        std::string  prefix;
+        char_set     body;
+        std::string  terminator;
+        // quoted only
+        char         escape = 0;
+        char_set     escaped;
+    };
+
+    //
+    // Returns the scanner that matches exactly what the pattern would
+    // match, if there is one.
+    //
+    std::optional<skip_scanner> find_skip_scanner(const lexer_pattern& pattern);
+
+    //
+    // A minimized DFA over byte equivalence classes.
+    //
+    // State 0 is the dead state. State 1 is the start state.
+    //
+    struct lexer_dfa {
+        std::array<int, 256> byte_class{};
+        int class_count = 0;
+        int state_count = 0;
+        // next state = transitions[state * class_count + byte_class[c]]
+        std::vector<int> transitions;
+        // index of the pattern accepted in this state or -1
+        std::vector<int> accept;
+        // Only filled in if lexer_build_options::accept_lists is set.
+        // Every pattern accepted in state s, highest priority first, is
+        // accept_list[accept_start[s]] .. accept_list[accept_start[s+1] - 1]
+        std::vector<int> accept_start;
+        std::vector<int> accept_list;
+
+        bool empty() const { return state_count == 0; }
+
+        int next_state(int state, unsigned char c) const {
+            return transitions[state * class_count + byte_class[c]];
+        }
+
+        //
+        // Run the DFA over the start of `input`.
+        // returns {pattern index, length} of the longest match
+        // or {-1, 0} if nothing (non-empty) matched.
+        //
+        std::pair<int, std::size_t> longest_match(std::string_view input) const;
+    };
+
+    //
+    // The combined NFA for the patterns, for the generated lexer to build
+    // DFA states from as it needs them (lexer.engine lazy). This keeps the
+    // tables linear in the size of the patterns when the full DFA would be
+    // huge (e.g. large counted repeats).
+    //
+    // State 0 is the start state. The byte classes are as for lexer_dfa.
+    //
+    struct lexer_nfa {
+        std::array<int, 256> byte_class{};
+        int class_count = 0;
+        // one entry per state.
+        // byte transition - index into set_classes (-1 if none) and target.
+        std::vector<int> set;
+        std::vector<int> next;
+        // index of the pattern accepted in this state or -1
+        std::vector<int> accept;
+        // epsilon moves of state s are eps[eps_start[s] .. eps_start[s+1])
+        std::vector<int> eps_start;
+        std::vector<int> eps;
+        // set_classes[set * class_count + class] - does the set hold bytes
+        // of the class?
+        std::vector<bool> set_classes;
+
+        bool empty() const { return set.empty(); }
+        int state_count() const { return int(set.size()); }
+        int set_count() const {
+            return class_count == 0 ? 0 : int(set_classes.size()) / class_count;
+        }
+
+        //
+        // Same as lexer_dfa::longest_match(), by simulating the NFA.
+        //
+        std::pair<int, std::size_t> longest_match(std::string_view input) const;
+    };
+
+    //
+    // Keywords that can be left out of the lexer altogether. Each is
+    // matched by an identifier-like term defined after it, and the term's
+    // lexeme is looked up in a keyword_table to find the keyword.
+    //
+    // One entry per pattern - the index of the term the pattern is
+    // promoted from, or -1 if it is matched in the usual way.
+    //
+    // A string term K is promoted to the first term I after it that
+    // matches everything K does (with case folding taken into account),
+    // as long as no pattern in between can match any of it.
+    // Then whenever the full lexer would pick K, I is the longest match
+    // without K, and the lexeme is K.
+    //
+    std::vector<int> find_keyword_promotions(const std::vector<lexer_pattern>& patterns);
+
+    //
+    // FNV-1a, seeded, over the bytes with ASCII upper case folded to
+    // lower case. The generated lexer has the same function.
+    //
+    std::uint32_t keyword_hash(std::string_view text, std::uint32_t seed);
+
+    //
+    // A perfect hash of the keywords promoted to one term.
+    // slots.size() is a power of 2. Each slot holds the index of the
+    // keyword pattern that hashes there, or -1. slots is empty if no
+    // seed keeps the keywords apart.
+    //
+    struct keyword_table {
+        int              pattern;
+        std::uint32_t    seed = 0;
+        std::vector<int> slots;
+    };
+
+    keyword_table build_keyword_table(const std::vector<lexer_pattern>& patterns,
+            int pattern, const std::vector<int>& keywords);
+
+    struct lexer_tables {
+        lexer_dfa dfa;
+        // only built instead of dfa when asked for
+        lexer_nfa nfa;
+        // One entry per pattern. Empty if the pattern is part of the DFA
+        // (or promoted), otherwise the reason it must be matched with
+        // std::regex.
+        std::vector<std::string> fallback;
+        // One entry per pattern. Skips that are matched by a skip_scanner
+        // rather than the DFA.
+        std::vector<std::optional<skip_scanner>> scanners;
+        // See find_keyword_promotions(). Promoted patterns are not in the
+        // DFA.
+        std::vector<int> promoted_to;
+    };
+
+    struct lexer_build_options {
+        // Leave the keywords that find_keyword_promotions() finds out of
+        // the DFA.
+        bool promote_keywords = false;
+        // Fill in `nfa` rather than `dfa`. The patterns that go into it are
+        // the same, except that none are left to std::regex because the
+        // combined DFA would be too large.
+        bool lazy = false;
+        // Keep every pattern each DFA state accepts, not just the first.
+        // States that accept different lists are not merged.
+        bool accept_lists = false;
+        // Leave the delimited skips and terms out of the DFA, to be
+        // matched by skip_scanners.
+        bool scanners = true;
+    };
+
+    lexer_tables generate_lexer_tables(const std::vector<lexer_pattern>& patterns,
+            const lexer_build_options& options = {});
+
+    // The options the generated lexer is built with.
+    lexer_build_options lexer_options_for(lexer_engine_type engine, bool contextual);
+
+    //
+    // How the generated lexer will match a pattern, and what that costs.
+    //
+    // dfa, lazy_dfa, scanner and string all run in time linear in the
+    // length of the match. regex (std::regex) may not. For those, hazards lists the
+    // constructs that are known to make ECMAScript backtracking blow up,
+    // and deep_recursion says if libstdc++ will recurse once per repetition
+    // (and so can run out of stack on long input).
+    //
+    enum class pattern_engine { dfa, lazy_dfa, scanner, string, regex };
+
+    struct pattern_cost {
+        pattern_engine           engine = pattern_engine::regex;
+        // why the pattern has to be left to std::regex
+        std::string              reason;
+        std::vector<std::string> hazards;
+        bool                     deep_recursion = false;
+
+        bool linear() const { return engine != pattern_engine::regex; }
+    };
+
+    pattern_cost analyze_pattern_cost(const lexer_pattern& pattern,
+            lexer_engine_type engine);
+
+    //
+    // The cost of each pattern as part of the lexer built from all of
+    // them (in priority order). A pattern that is linear on its own is
+    // still left to std::regex if the combined DFA is too large.
+    //
+    std::vector<pattern_cost> analyze_pattern_costs(
+            const std::vector<lexer_pattern>& patterns,
+            lexer_engine_type engine, bool contextual);
+
+    // What deep_recursion means, for warnings and reports.
+    extern const char * const deep_recursion_hazard;
+
+    const char *pattern_engine_name(pattern_engine e);
+
+    //
+    // The bytes that can start a (non-empty) match of the pattern.
+    // If the pattern can't be parsed, this is every byte.
+    //
+    char_set pattern_first_chars(const lexer_pattern& pattern);
+
+} // namespace yalr
+
+#endif
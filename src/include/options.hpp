@@ -144,6 +144,67 @@ struct lexer_case_option : public option<case_type, lexer_case_option> {
 };
 
 
+/*********************************************************
+ * Option class for lexer_engine_type. Can only be set once.
+ *********************************************************/
+struct lexer_engine_option : public option<lexer_engine_type, lexer_engine_option> {
+    lexer_engine_option(std::string_view v, _option_table_base& parent, lexer_engine_type def) : 
+        option{v, *this, parent, false, def} {}
+
+    bool validate(std::string_view val) {
+        if (val == "dfa") {
+            return set(lexer_engine_type::dfa);
+        } else if (val == "lazy") {
+            return set(lexer_engine_type::lazy);
+        } else if (val == "regex") {
+            return set(lexer_engine_type::regex);
+        }
+
+        return false;
+    };
+};
+
+
+/*********************************************************
+ * Option class for parser_style_type. Can only be set once.
+ *********************************************************/
+struct parser_style_option : public option<parser_style_type, parser_style_option> {
+    parser_style_option(std::string_view v, _option_table_base& parent, parser_style_type def) : 
+        option{v, *this, parent, false, def} {}
+
+    bool validate(std::string_view val) {
+        if (val == "recursive") {
+            return set(parser_style_type::recursive);
+        } else if (val == "table") {
+            return set(parser_style_type::table);
+        } else if (val == "trampoline") {
+            return set(parser_style_type::trampoline);
+        }
+
+        return false;
+    };
+};
+
+
+/*********************************************************
+ * Option class for lexeme_type. Can only be set once.
+ *********************************************************/
+struct lexer_lexeme_option : public option<lexeme_type, lexer_lexeme_option> {
+    lexer_lexeme_option(std::string_view v, _option_table_base& parent, lexeme_type def) : 
+        option{v, *this, parent, false, def} {}
+
+    bool validate(std::string_view val) {
+        if (val == "string") {
+            return set(lexeme_type::string);
+        } else if (val == "view") {
+            return set(lexeme_type::view);
+        }
+
+        return false;
+    };
+};
+
+
 /*****************************************************************************
  * Option Table
  *****************************************************************************/
@@ -152,9 +213,15 @@ struct option_table : public _option_table_base {
     //                              name                     default
     sv_once_option      lexer_class{"lexer.class",    *this, "Lexer"};
     sv_once_option     parser_class{"parser.class",   *this, "Parser"};
+    parser_style_option parser_style{"parser.style",   *this, parser_style_type::recursive};
     sv_once_option   code_namespace{"code.namespace", *this, "YalrParser"};
     lexer_case_option    lexer_case{"lexer.case",     *this, case_type::match};
+    lexer_engine_option lexer_engine{"lexer.engine",   *this, lexer_engine_type::dfa};
+    lexer_lexeme_option lexer_lexeme{"lexer.lexeme",   *this, lexeme_type::string};
+    bool_option      lexer_parallel{"lexer.parallel", *this, false};
+    bool_option    lexer_contextual{"lexer.contextual", *this, false};
     bool_option           code_main{"code.main",      *this, false};
+    bool_option         code_parser{"code.parser",    *this, true};
 
 };
 
@@ -0,0 +1,103 @@
+#if not defined(YALR_REGEX_TREE_HPP)
+#define YALR_REGEX_TREE_HPP
+
+#include "constants.hpp"
+
+#include <bitset>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <iostream>
+
+namespace yalr {
+
+    //
+    // A set of bytes. Case folding has already been applied by the
+    // time one of these ends up in a tree.
+    //
+    using char_set = std::bitset<256>;
+
+    enum class regex_node_type {
+        empty,      // matches the empty string
+        chars,      // matches exactly one byte from `chars`
+        concat,     // children in order
+        alternate,  // any one of the children
+        repeat,     // children[0] repeated min..max times
+        assertion,  // ^ $ \b \B - zero width
+        backref,    // \1 .. \9
+        lookahead   // (?= ) (?! ) - zero width
+    };
+
+    struct regex_node {
+        regex_node_type type = regex_node_type::empty;
+        char_set chars;
+        std::vector<regex_node> children;
+        // repeat bounds. max == -1 means no upper bound.
+        int min = 0;
+        int max = -1;
+        // repeat - non-greedy quantifier (e.g. *?)
+        bool lazy = false;
+        // lookahead - (?! ) rather than (?= )
+        bool negated = false;
+        // assertion - the character that names it (^ $ b B)
+        // backref   - the group number
+        int value = 0;
+
+        regex_node() = default;
+        explicit regex_node(regex_node_type t) : type(t) {}
+        explicit regex_node(const char_set& cs) :
+            type(regex_node_type::chars), chars(cs) {}
+    };
+
+    //
+    // Result of parsing a pattern.
+    //
+    // ok          - `tree` is valid.
+    // unsupported - the pattern uses syntax that yalr does not understand.
+    //               std::regex may or may not accept it.
+    // invalid     - std::regex would reject the pattern as well.
+    //
+    enum class regex_status { ok, unsupported, invalid };
+
+    struct regex_parse_result {
+        regex_status status = regex_status::ok;
+        regex_node   tree;
+        std::string  message;
+        int          offset = 0;
+
+        operator bool() const { return status == regex_status::ok; }
+    };
+
+    //
+    // Parse a pattern as ECMAScript (the std::regex default) would.
+    //
+    regex_parse_result parse_regex(std::string_view pattern, case_type ct);
+
+    //
+    // Check that the generated lexer will be able to use the pattern.
+    // Returns an empty string if so, otherwise what is wrong with it.
+    //
+    std::string validate_regex(std::string_view pattern, case_type ct);
+
+    //
+    // Build the tree for a single-quote style (fixed string) pattern.
+    //
+    regex_node literal_regex(std::string_view text, case_type ct);
+
+    //
+    // Can the tree match the empty string?
+    //
+    bool nullable(const regex_node& node);
+
+    //
+    // The bytes that can start a non-empty match of the tree.
+    // This is conservative - it may contain bytes that can't actually
+    // start a match, but never misses one that can.
+    //
+    char_set first_chars(const regex_node& node);
+
+    std::ostream& pretty_print(const regex_node& node, std::ostream& strm);
+
+} // namespace yalr
+
+#endif
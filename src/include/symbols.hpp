@@ -27,6 +27,10 @@ struct terminal_symbol {
     std::string_view    pattern;
     std::string_view    token_name;
     std::string_view    action;
+    // For the built in types the lexer converts the lexeme to itself (e.g.
+    // @int64 or @atom), the name of the type without the @. There is no
+    // action.
+    std::string_view    builtin_type;
     // These will need to be computed in the analyzer
     assoc_type          associativity = assoc_type::undef;
     std::optional<int>  precedence = std::nullopt;
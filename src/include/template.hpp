@@ -13,6 +13,39 @@ R"DELIM(/* build time date version goes here */
 #include <algorithm>
 #include <variant>
 #include <string_view>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <new>
+#include <cstring>
+#include <iterator>
+#include <type_traits>
+#include <mutex>
+#include <optional>
+#include <system_error>
+#include <charconv>
+## if lexer.nfa.use_lazy
+#include <unordered_map>
+## endif
+## if lexer_parallel
+#include <future>
+#include <thread>
+#define YALR_PARALLEL_LEX
+## endif
+## if has_atoms
+#define YALR_ATOMS
+## endif
+## if lexeme_view
+#define YALR_LEXEME_VIEW
+## endif
+#if defined(__unix__) || defined(__APPLE__)
+#  define YALR_POSIX_IO
+#  include <unistd.h>
+#  include <cerrno>
+#  include <fcntl.h>
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#endif
 
 /***** verbatim file.top ********/
 ## for v in verbatim.file_top
@@ -54,9 +87,183 @@ enum token_type {
 
 struct Token {
     token_type toktype;
+    // Where the token is in the input. Lexer::location() turns the
+    // offset into a line and column.
+    std::uint32_t length = 0;
+    std::uint64_t offset = 0;
     Token(token_type t = undef) : toktype(t) {}
+    Token(token_type t, std::uint64_t o, std::uint32_t l) :
+        toktype(t), length(l), offset(o) {}
+};
+
+struct source_location {
+    // both start at 1. The column is in bytes.
+    std::uint64_t line;
+    std::uint64_t column;
+};
+
+//
+// A token the lexer matched but could not turn into a value - e.g. a number
+// too big for @int64. The token is returned as undef, which no parser
+// state accepts.
+//
+struct lex_error {
+    std::uint64_t offset;
+    std::uint32_t length;
+    const char   *message;
+};
+
+//
+// For the @int64, @uint64 and @double types. Converts the text as it is in
+// the input - no copy, no locale. Returns nullptr if it worked, otherwise
+// what was wrong.
+//
+template <typename T>
+const char *lexeme_to_number(const char *first, std::size_t len, T& value) {
+    const char *last = first + len;
+    // from_chars only takes a leading -, and it mustn't follow a +
+    if (first != last and *first == '+') {
+        ++first;
+        if (first != last and *first == '-') {
+            return "not a number";
+        }
+    }
+    auto [ptr, ec] = std::from_chars(first, last, value);
+    if (ec == std::errc::result_out_of_range) {
+        return "number is out of range";
+    } else if (ec != std::errc() or ptr != last) {
+        return "not a number";
+    }
+    return nullptr;
+}
+
+## if has_atoms
+//
+// The value of an @atom term. Equal lexemes get the same id, so ids can be
+// compared (or used to index a vector) instead of the text. The text lives
+// in the symbol_pool that interned it.
+//
+struct atom {
+    static constexpr std::uint32_t none = UINT32_MAX;
+
+    std::uint32_t    id = none;
+    std::string_view text;
+
+    friend bool operator==(const atom& a, const atom& b) { return a.id == b.id; }
+    friend bool operator!=(const atom& a, const atom& b) { return a.id != b.id; }
+    friend bool operator<(const atom& a, const atom& b) { return a.id < b.id; }
+    friend std::ostream& operator<<(std::ostream& strm, const atom& a) {
+        return strm << a.text;
+    }
+};
+
+//
+// Interns the lexemes of @atom terms. Ids are handed out from 0 in the
+// order the lexemes are first seen. The table is open addressed (linear
+// probing) and kept at most half full, so finding a lexeme that is
+// already there is one hash and usually one probe, with no allocation.
+// New text is copied into blocks that never move, so the views stay
+// valid for as long as the pool does.
+//
+class symbol_pool {
+public:
+    atom intern(std::string_view text) {
+        if ((ids.size() + 1) * 2 > slots.size()) {
+            grow();
+        }
+        auto h = hash(text);
+        auto mask = slots.size() - 1;
+        for (auto i = std::size_t(h) & mask; ; i = (i + 1) & mask) {
+            auto slot = slots[i];
+            if (slot == 0) {
+                auto id = std::uint32_t(ids.size());
+                ids.push_back(store(text));
+                hashes.push_back(h);
+                slots[i] = id + 1;
+                return atom{id, ids.back()};
+            }
+            if (hashes[slot - 1] == h and ids[slot - 1] == text) {
+                return atom{slot - 1, ids[slot - 1]};
+            }
+        }
+    }
+
+    // The atom for `text` if it has been interned, otherwise id is none.
+    atom find(std::string_view text) const {
+        if (slots.empty()) {
+            return atom{atom::none, text};
+        }
+        auto h = hash(text);
+        auto mask = slots.size() - 1;
+        for (auto i = std::size_t(h) & mask; slots[i] != 0; i = (i + 1) & mask) {
+            auto slot = slots[i];
+            if (hashes[slot - 1] == h and ids[slot - 1] == text) {
+                return atom{slot - 1, ids[slot - 1]};
+            }
+        }
+        return atom{atom::none, text};
+    }
+
+    std::string_view text(std::uint32_t id) const { return ids[id]; }
+
+    std::size_t size() const { return ids.size(); }
+
+private:
+    static constexpr std::size_t block_size = 16 * 1024;
+
+    // id + 1 of the text that hashes here, or 0 if empty
+    std::vector<std::uint32_t> slots;
+    // one entry per id
+    std::vector<std::string_view> ids;
+    std::vector<std::uint32_t> hashes;
+
+    std::vector<std::unique_ptr<char[]>> blocks;
+    char *block_next = nullptr;
+    std::size_t block_left = 0;
+
+    // FNV-1a
+    static std::uint32_t hash(std::string_view text) {
+        std::uint32_t h = 2166136261u;
+        for (unsigned char c : text) {
+            h = (h ^ c) * 16777619u;
+        }
+        return h;
+    }
+
+    void grow() {
+        slots.assign(std::max(slots.size() * 2, std::size_t(64)), 0);
+        auto mask = slots.size() - 1;
+        for (std::uint32_t id = 0; id < ids.size(); ++id) {
+            auto i = std::size_t(hashes[id]) & mask;
+            while (slots[i] != 0) {
+                i = (i + 1) & mask;
+            }
+            slots[i] = id + 1;
+        }
+    }
+
+    std::string_view store(std::string_view text) {
+        if (text.size() > block_left) {
+            // Big lexemes get a block of their own so that the rest of
+            // the current block isn't wasted.
+            if (text.size() > block_size / 4) {
+                blocks.push_back(std::make_unique<char[]>(text.size()));
+                std::memcpy(blocks.back().get(), text.data(), text.size());
+                return { blocks.back().get(), text.size() };
+            }
+            blocks.push_back(std::make_unique<char[]>(block_size));
+            block_next = blocks.back().get();
+            block_left = block_size;
+        }
+        std::memcpy(block_next, text.data(), text.size());
+        std::string_view retval{block_next, text.size()};
+        block_next += text.size();
+        block_left -= text.size();
+        return retval;
+    }
 };
 
+## endif
 enum state_action { undefined, reduce, accept, error };
 
 struct rettype {
@@ -69,13 +276,70 @@ struct rettype {
 
 using iter_type = std::string::const_iterator;
 
+//
+// Values bigger than this are kept out of line (in a boxed<T>), so that one
+// large type does not make every slot on the parse stack, and in a
+// token_buffer, that large.
+//
+constexpr std::size_t max_inline_value = 32;
+
+template <typename T>
+struct boxed {
+    std::unique_ptr<T> p;
+};
+
+template <typename T>
+using value_slot = std::conditional_t<(sizeof(T) <= max_inline_value), T, boxed<T>>;
+
 using semantic_value = std::variant<
     std::monostate
 ## for t in types
-    , <% t %>
+    , value_slot<<% t %>>
 ## endfor
     >;
 
+template <typename T, typename U>
+semantic_value make_value(U&& u) {
+    if constexpr (std::is_same_v<value_slot<T>, T>) {
+        return semantic_value{std::in_place_type<T>, std::forward<U>(u)};
+    } else {
+        return semantic_value{std::in_place_type<boxed<T>>,
+            boxed<T>{std::make_unique<T>(std::forward<U>(u))}};
+    }
+}
+
+// The T in `sv`, or nullptr if it holds something else.
+template <typename T>
+T *value_if(semantic_value& sv) {
+    if constexpr (std::is_same_v<value_slot<T>, T>) {
+        return std::get_if<T>(&sv);
+    } else {
+        auto *b = std::get_if<boxed<T>>(&sv);
+        return b ? b->p.get() : nullptr;
+    }
+}
+
+//
+// Move the T out of `sv`. The parser knows the type of each symbol on its
+// stack, so this is not checked.
+//
+template <typename T>
+T take_value(semantic_value& sv) {
+    if constexpr (std::is_same_v<value_slot<T>, T>) {
+        return std::move(*std::get_if<T>(&sv));
+    } else {
+        return std::move(*std::get_if<boxed<T>>(&sv)->p);
+    }
+}
+
+// Can the value be written to a std::ostream?
+template <typename T, typename = void>
+struct is_printable : std::false_type {};
+
+template <typename T>
+struct is_printable<T, std::void_t<decltype(
+        std::declval<std::ostream&>() << std::declval<const T&>())>> : std::true_type {};
+
 struct value_printer {
     void operator()(const std::monostate& m) {
         std::cerr << "(void)";
@@ -84,9 +348,19 @@ struct value_printer {
         std::cerr << "'" << s << "'";
     }
 
+    template<typename T>
+    void operator()(const boxed<T> & b) {
+        (*this)(*b.p);
+    }
+
+    // e.g. std::unique_ptr or std::vector
     template<typename T>
     void operator()(const T & t) {
-        std::cerr << t;
+        if constexpr (is_printable<T>::value) {
+            std::cerr << t;
+        } else {
+            std::cerr << "(value)";
+        }
     }
 };
 
@@ -97,21 +371,89 @@ struct token_value {
     token_value() {}
     token_value(Token pt) : t{pt} {};
     token_value(token_type pt) : t{Token{pt}} {};
-    token_value(token_type pt, semantic_value sv) : t{Token{pt}}, v{sv} {};
+    token_value(token_type pt, semantic_value sv) : t{Token{pt}}, v{std::move(sv)} {};
+    token_value(Token pt, semantic_value sv) : t{pt}, v{std::move(sv)} {};
 };
 
+//
+// Tokens lexed ahead of the parser, kept as parallel arrays - one entry
+// per token in each. Filled by Lexer::lex_into().
+//
+struct token_buffer {
+    std::vector<token_type>     types;
+    std::vector<std::uint64_t>  offsets;
+    std::vector<std::uint32_t>  lengths;
+    std::vector<semantic_value> values;
+
+    std::size_t size() const { return types.size(); }
+    bool empty() const { return types.empty(); }
+
+    void clear() {
+        types.clear();
+        offsets.clear();
+        lengths.clear();
+        values.clear();
+    }
+
+    void reserve(std::size_t n) {
+        types.reserve(n);
+        offsets.reserve(n);
+        lengths.reserve(n);
+        values.reserve(n);
+    }
+
+    void push_back(token_value&& tv) {
+        types.push_back(tv.t.toktype);
+        offsets.push_back(tv.t.offset);
+        lengths.push_back(tv.t.length);
+        values.push_back(std::move(tv.v));
+    }
+
+    Token token(std::size_t i) const {
+        return Token{types[i], offsets[i], lengths[i]};
+    }
+
+    // Move the tokens from index `from` on in `other` onto the end.
+    void append(token_buffer& other, std::size_t from = 0) {
+        auto n = std::ptrdiff_t(from);
+        types.insert(types.end(), other.types.begin() + n, other.types.end());
+        offsets.insert(offsets.end(), other.offsets.begin() + n, other.offsets.end());
+        lengths.insert(lengths.end(), other.lengths.begin() + n, other.lengths.end());
+        values.insert(values.end(),
+                std::make_move_iterator(other.values.begin() + n),
+                std::make_move_iterator(other.values.end()));
+    }
+};
+
+inline const char *token_name(token_type t) {
+    switch (t) {
+## for entry in enums
+        case <%entry.name%> : return "<%entry.name%>";
+## endfor
+    }
+    return "?";
+}
+
 struct matcher {
+    //
+    // Returns {true, length} on a match. A matcher that ran out of input
+    // before it could decide returns {false, -1} so that a streaming
+    // lexer knows to read more and try again.
+    //
     virtual std::pair<bool, int>
-    try_match(iter_type first, const iter_type last) = 0;
+    try_match(const char *first, const char *last) const = 0;
 
-    virtual ~matcher() {}
+protected:
+    // Matchers are only ever static objects - never deleted through
+    // a base pointer. Keeping this trivial lets them be constexpr.
+    ~matcher() = default;
 };
 
 struct string_matcher : matcher {
-    std::string pattern;
-    string_matcher(std::string p) : pattern{p} {};
+    std::string_view pattern;
+    constexpr string_matcher(std::string_view p) : pattern{p} {};
     virtual std::pair<bool, int>
-    try_match(iter_type first, const iter_type last) override {
+    try_match(const char *first, const char *last) const override {
         if (std::size_t(last - first) < pattern.size()) {
             return std::make_pair(false, 0);
         } else if (std::equal(pattern.begin(), pattern.end(), first)) {
@@ -123,10 +465,10 @@ struct string_matcher : matcher {
 };
 
 struct fold_string_matcher : matcher {
-    std::string pattern;
-    fold_string_matcher(std::string p) : pattern{p} {};
+    std::string_view pattern;
+    constexpr fold_string_matcher(std::string_view p) : pattern{p} {};
     virtual std::pair<bool, int>
-    try_match(iter_type first, const iter_type last) override {
+    try_match(const char *first, const char *last) const override {
         if (std::size_t(last - first) < pattern.size()) {
             return std::make_pair(false, 0);
         } else if (std::equal(pattern.begin(), pattern.end(), first, 
@@ -140,24 +482,37 @@ struct fold_string_matcher : matcher {
     }
 };
 
+//
+// std::regex can't be built at compile time, so it is built the first
+// time it is needed rather than when the program starts. yalr has
+// already checked that the pattern compiles.
+//
 struct regex_matcher : matcher {
-    std::regex pattern;
-    regex_matcher(std::string p, const std::regex_constants::syntax_option_type& opt) try : pattern{p, opt} {
-         {}
-    } catch (std::regex_error &e) {
-        std::cerr << "Error when compiling pattern '" << p << "'\n";
-        throw e;
-    }
-    regex_matcher(std::string p) try : pattern{p} {
-         {}
-    } catch (std::regex_error &e) {
-        std::cerr << "Error when compiling pattern '" << p << "'\n";
-        throw e;
+    std::string_view source;
+    std::regex_constants::syntax_option_type flags;
+    mutable std::once_flag compiled;
+    mutable std::optional<std::regex> pattern;
+
+    constexpr regex_matcher(std::string_view p,
+            std::regex_constants::syntax_option_type opt = std::regex::ECMAScript) :
+        source{p}, flags{opt} {}
+
+    const std::regex& get_pattern() const {
+        std::call_once(compiled, [this] {
+            try {
+                pattern.emplace(source.begin(), source.end(), flags);
+            } catch (std::regex_error &e) {
+                std::cerr << "Error when compiling pattern '" << source << "'\n";
+                throw;
+            }
+        });
+        return *pattern;
     }
+
     virtual std::pair<bool, int>
-    try_match(iter_type first, const iter_type last) override {
-        std::match_results<iter_type> mr;
-        if (std::regex_search(first, last, mr, pattern, 
+    try_match(const char *first, const char *last) const override {
+        std::cmatch mr;
+        if (std::regex_search(first, last, mr, get_pattern(),
                 std::regex_constants::match_continuous)) {
             auto len = mr.length(0);
             return std::make_pair(true, len);
@@ -167,14 +522,698 @@ struct regex_matcher : matcher {
     }
 };
 
-using match_ptr = std::shared_ptr<matcher>;
+/************** skip scanners *****************/
+//
+// Matchers for the common shapes of skip pattern - runs of whitespace,
+// line comments and block comments - and of delimited terms like string
+// literals. yalr picks these when it generates the lexer. They compare 16
+// or 32 bytes at a time where the target allows it.
+//
+#if (defined(__AVX2__) || defined(__SSE2__)) && (defined(__GNUC__) || defined(__clang__))
+#  define YALR_SIMD_SCAN
+#  include <immintrin.h>
+#endif
+
+struct byte_set {
+    bool table[256] = {};
+    // The bytes that were written out (the set or its complement) if
+    // there are few enough of them to compare a vector at a time.
+    char list[8] = {};
+    int  list_count = 0;
+    bool list_members = true;
+
+    constexpr byte_set(std::string_view bytes, bool members) : list_members{members} {
+        for (auto c : bytes) {
+            table[static_cast<unsigned char>(c)] = true;
+        }
+        if (not members) {
+            for (auto &t : table) {
+                t = not t;
+            }
+        }
+        if (bytes.size() <= sizeof(list)) {
+            list_count = int(bytes.size());
+            for (int i = 0; i < list_count; ++i) {
+                list[i] = bytes[i];
+            }
+        }
+    }
+
+    constexpr bool contains(char c) const {
+        return table[static_cast<unsigned char>(c)];
+    }
+};
+
+//
+// Returns the first position in [p, last) where set.contains() != in.
+//
+inline const char *span_bytes(const char *p, const char *last,
+        const byte_set& set, bool in) {
+    // Looking for one particular byte - the C library does this best.
+    if (set.list_count == 1 and in != set.list_members) {
+        auto q = std::memchr(p, set.list[0], std::size_t(last - p));
+        return (q == nullptr ? last : static_cast<const char *>(q));
+    }
+#if defined(YALR_SIMD_SCAN)
+    if (set.list_count > 0) {
+        // Stop at a byte that is in the list (or one that isn't).
+        const bool stop_on_hit = (in != set.list_members);
+#  if defined(__AVX2__)
+        while (last - p >= 32) {
+            __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+            __m256i hit = _mm256_setzero_si256();
+            for (int i = 0; i < set.list_count; ++i) {
+                hit = _mm256_or_si256(hit,
+                        _mm256_cmpeq_epi8(v, _mm256_set1_epi8(set.list[i])));
+            }
+            auto bits = unsigned(_mm256_movemask_epi8(hit));
+            if (not stop_on_hit) {
+                bits = ~bits;
+            }
+            if (bits != 0) {
+                return p + __builtin_ctz(bits);
+            }
+            p += 32;
+        }
+#  endif
+        while (last - p >= 16) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+            __m128i hit = _mm_setzero_si128();
+            for (int i = 0; i < set.list_count; ++i) {
+                hit = _mm_or_si128(hit,
+                        _mm_cmpeq_epi8(v, _mm_set1_epi8(set.list[i])));
+            }
+            auto bits = unsigned(_mm_movemask_epi8(hit));
+            if (not stop_on_hit) {
+                bits = ~bits & 0xFFFFu;
+            }
+            if (bits != 0) {
+                return p + __builtin_ctz(bits);
+            }
+            p += 16;
+        }
+    }
+#endif
+    while (p != last and set.contains(*p) == in) {
+        ++p;
+    }
+    return p;
+}
+
+// [body]+
+struct run_scanner : matcher {
+    byte_set body;
+    constexpr run_scanner(byte_set b) : body{b} {};
+    virtual std::pair<bool, int>
+    try_match(const char *first, const char *last) const override {
+        auto len = span_bytes(first, last, body, true) - first;
+        return std::make_pair(len > 0, int(len));
+    }
+};
+
+// prefix [body]* terminator? - the terminator is at most one byte
+struct line_scanner : matcher {
+    std::string_view prefix;
+    byte_set body;
+    std::string_view terminator;
+    constexpr line_scanner(std::string_view p, byte_set b, std::string_view t) :
+        prefix{p}, body{b}, terminator{t} {};
+    virtual std::pair<bool, int>
+    try_match(const char *first, const char *last) const override {
+        if (std::size_t(last - first) < prefix.size() or
+                not std::equal(prefix.begin(), prefix.end(), first)) {
+            return std::make_pair(false, 0);
+        }
+        auto q = span_bytes(first + prefix.size(), last, body, true);
+        if (not terminator.empty()) {
+            if (q == last) {
+                return std::make_pair(false, -1);
+            } else if (*q != terminator[0]) {
+                return std::make_pair(false, 0);
+            }
+            ++q;
+        }
+        return std::make_pair(true, int(q - first));
+    }
+};
+
+// prefix [body]*? terminator
+struct block_scanner : matcher {
+    std::string_view prefix;
+    // bytes not in the body plus the first byte of the terminator
+    byte_set stop;
+    std::string_view terminator;
+    bool term_in_body;
+    constexpr block_scanner(std::string_view p, byte_set s, std::string_view t, bool tib) :
+        prefix{p}, stop{s}, terminator{t}, term_in_body{tib} {};
+    virtual std::pair<bool, int>
+    try_match(const char *first, const char *last) const override {
+        if (std::size_t(last - first) < prefix.size() or
+                not std::equal(prefix.begin(), prefix.end(), first)) {
+            return std::make_pair(false, 0);
+        }
+        auto q = first + prefix.size();
+        for (;;) {
+            q = span_bytes(q, last, stop, false);
+            if (q == last or std::size_t(last - q) < terminator.size()) {
+                return std::make_pair(false, -1);
+            }
+            if (std::equal(terminator.begin(), terminator.end(), q)) {
+                return std::make_pair(true, int(q + terminator.size() - first));
+            }
+            if (*q != terminator[0] or not term_in_body) {
+                return std::make_pair(false, 0);
+            }
+            ++q;
+        }
+    }
+};
+
+// prefix (?:[body]|escape[escaped])* terminator - greedy or not
+struct quoted_scanner : matcher {
+    std::string_view prefix;
+    // bytes not in the body - including the escape and terminator
+    byte_set stop;
+    char escape;
+    byte_set escaped;
+    char terminator;
+    constexpr quoted_scanner(std::string_view p, byte_set s, int e, byte_set ed, int t) :
+        prefix{p}, stop{s}, escape{char(e)}, escaped{ed}, terminator{char(t)} {};
+    virtual std::pair<bool, int>
+    try_match(const char *first, const char *last) const override {
+        if (std::size_t(last - first) < prefix.size() or
+                not std::equal(prefix.begin(), prefix.end(), first)) {
+            return std::make_pair(false, 0);
+        }
+        auto q = first + prefix.size();
+        for (;;) {
+            q = span_bytes(q, last, stop, false);
+            if (q == last) {
+                return std::make_pair(false, -1);
+            }
+            if (*q == terminator) {
+                return std::make_pair(true, int(q + 1 - first));
+            }
+            if (*q != escape) {
+                return std::make_pair(false, 0);
+            }
+            if (q + 1 == last) {
+                return std::make_pair(false, -1);
+            }
+            if (not escaped.contains(q[1])) {
+                return std::make_pair(false, 0);
+            }
+            q += 2;
+        }
+    }
+};
+
+using match_ptr = const matcher *;
+## if lexer_contextual
+
+//
+// A set of patterns, by their index (definition order).
+//
+struct pattern_set {
+    std::uint64_t words[<% state_patterns.words %>];
+
+    constexpr bool contains(int index) const {
+        return (words[index / 64] >> (index % 64)) & 1u;
+    }
+};
+## endif
+
+/************** lexer tables *****************/
 
-std::vector<std::pair<match_ptr, token_type>> patterns = {
+## if lexer.use_dfa or lexer.nfa.use_lazy
+// The token for each pattern. The index is the order the pattern was
+// defined in the grammar - and so its priority.
+constexpr token_type pattern_tokens[] = {
+## for tok in pattern_tokens
+    <% tok %>,
+## endfor
+};
+## endif
+
+## if lexer.use_dfa
+// Combined DFA for the patterns.
+// <% lexer.state_count %> states, <% lexer.class_count %> byte classes.
+// State 0 is the dead state, state 1 is the start state.
+constexpr int dfa_class_count = <% lexer.class_count %>;
+
+constexpr std::uint8_t dfa_byte_class[256] = {
+## for row in lexer.byte_class
+    <% row %>
+## endfor
+};
+
+constexpr <% lexer.state_type %> dfa_transitions[] = {
+## for row in lexer.transitions
+    <% row %>
+## endfor
+};
+
+// pattern index + 1 accepted in each state. 0 if not accepting.
+constexpr <% lexer.accept_type %> dfa_accept[] = {
+## for row in lexer.accept
+    <% row %>
+## endfor
+};
+## if lexer.accept_lists
+
+// Every pattern accepted in state s, highest priority first, is
+// dfa_accept_list[dfa_accept_start[s]] .. dfa_accept_list[dfa_accept_start[s+1] - 1]
+constexpr <% lexer.accept_start_type %> dfa_accept_start[] = {
+## for row in lexer.accept_start
+    <% row %>
+## endfor
+};
+
+constexpr <% lexer.accept_list_type %> dfa_accept_list[] = {
+## for row in lexer.accept_list
+    <% row %>
+## endfor
+};
+## endif
+## endif
+
+## if lexer.nfa.use_lazy
+// Combined NFA for the patterns, which lazy_dfa builds DFA states from.
+// <% lexer.nfa.state_count %> states, <% lexer.nfa.class_count %> byte classes, <% lexer.nfa.set_count %> byte sets.
+// State 0 is the start state.
+constexpr int nfa_class_count = <% lexer.nfa.class_count %>;
+
+constexpr std::uint8_t nfa_byte_class[256] = {
+## for row in lexer.nfa.byte_class
+    <% row %>
+## endfor
+};
+
+// byte set + 1 of the transition out of each state. 0 if none.
+constexpr <% lexer.nfa.set_type %> nfa_set[] = {
+## for row in lexer.nfa.set
+    <% row %>
+## endfor
+};
+
+// where that transition goes
+constexpr <% lexer.nfa.state_type %> nfa_next[] = {
+## for row in lexer.nfa.next
+    <% row %>
+## endfor
+};
+
+// pattern index + 1 accepted in each state. 0 if not accepting.
+constexpr <% lexer.nfa.accept_type %> nfa_accept[] = {
+## for row in lexer.nfa.accept
+    <% row %>
+## endfor
+};
+
+// The epsilon moves out of state s are
+// nfa_eps[nfa_eps_start[s]] .. nfa_eps[nfa_eps_start[s+1] - 1]
+constexpr <% lexer.nfa.eps_start_type %> nfa_eps_start[] = {
+## for row in lexer.nfa.eps_start
+    <% row %>
+## endfor
+};
+
+constexpr <% lexer.nfa.state_type %> nfa_eps[] = {
+## for row in lexer.nfa.eps
+    <% row %>
+## endfor
+};
+
+// nfa_set_classes[set * nfa_class_count + class] - one row per byte set.
+constexpr bool nfa_set_classes[] = {
+## for row in lexer.nfa.set_classes
+    <% row %>
+## endfor
+};
+
+//
+// The DFA for the NFA above, built a state at a time as the input reaches
+// it. States are cached along with their transitions, so once the common
+// paths are built this runs as fast as the full table would. If the cache
+// fills up it is emptied and starts over, which bounds the memory used no
+// matter how big the full DFA would be.
+//
+// State 0 is the dead state, state 1 is the start state.
+//
+class lazy_dfa {
+public:
+    static constexpr std::size_t default_states = 4096;
+
+    explicit lazy_dfa(std::size_t max_states = default_states) :
+        max_states(std::max(max_states, std::size_t(3))),
+        seen(std::size(nfa_set), false) {
+        flush();
+    }
+
+    int start() const { return 1; }
+
+    // pattern index + 1 accepted in the state. 0 if not accepting.
+    int accept(int state) const { return accepts[state]; }
+
+    // Every pattern accepted in the state, highest priority first.
+    std::pair<const int *, const int *> accept_list(int state) const {
+        const auto *first = accept_all.data();
+        return { first + accept_start[state], first + accept_start[state + 1] };
+    }
+
+    int next(int state, unsigned char c) {
+        const auto slot = std::size_t(state) * nfa_class_count + nfa_byte_class[c];
+        auto retval = transitions[slot];
+        if (retval < 0) {
+            auto before = flushes;
+            retval = add_state(follow(state, nfa_byte_class[c]));
+            // a flush throws `state` away along with everything else
+            if (before == flushes) {
+                transitions[slot] = retval;
+            }
+        }
+        return retval;
+    }
+
+    std::size_t state_count() const { return sets.size(); }
+    // how many times the cache has been emptied
+    std::size_t flush_count() const { return flushes; }
+
+private:
+    // the NFA states with a byte transition or that accept, sorted.
+    using state_set = std::vector<int>;
+
+    struct set_hash {
+        std::size_t operator()(const state_set& s) const {
+            std::size_t h = s.size();
+            for (auto x : s) {
+                h = h * 31 + std::size_t(x);
+            }
+            return h;
+        }
+    };
+
+    std::size_t max_states;
+    std::vector<state_set> sets;
+    std::unordered_map<state_set, int, set_hash> ids;
+    // -1 if not built yet
+    std::vector<int> transitions;
+    std::vector<int> accepts;
+    // see accept_list()
+    std::vector<int> accept_start{0};
+    std::vector<int> accept_all;
+    std::size_t flushes = 0;
+
+    // scratch space for closure()
+    std::vector<bool> seen;
+    std::vector<int> stack;
+
+    void flush() {
+        if (not sets.empty()) {
+            ++flushes;
+        }
+        sets.clear();
+        ids.clear();
+        transitions.clear();
+        accepts.clear();
+        accept_start.assign(1, 0);
+        accept_all.clear();
+
+        add_state(state_set{});
+        state_set start{0};
+        closure(start);
+        add_state(std::move(start));
+    }
+
+    void closure(state_set& s) {
+        std::vector<int> all;
+        stack.assign(s.begin(), s.end());
+        while (not stack.empty()) {
+            auto n = stack.back();
+            stack.pop_back();
+            if (seen[n]) {
+                continue;
+            }
+            seen[n] = true;
+            all.push_back(n);
+            for (auto i = nfa_eps_start[n]; i < nfa_eps_start[n+1]; ++i) {
+                stack.push_back(nfa_eps[i]);
+            }
+        }
+
+        s.clear();
+        for (auto n : all) {
+            seen[n] = false;
+            if (nfa_set[n] != 0 or nfa_accept[n] != 0) {
+                s.push_back(n);
+            }
+        }
+        std::sort(s.begin(), s.end());
+    }
+
+    state_set follow(int state, int cls) {
+        state_set retval;
+        for (auto n : sets[state]) {
+            auto set = nfa_set[n];
+            if (set != 0 and nfa_set_classes[(set - 1) * nfa_class_count + cls]) {
+                retval.push_back(nfa_next[n]);
+            }
+        }
+        if (not retval.empty()) {
+            closure(retval);
+        }
+        return retval;
+    }
+
+    int add_state(state_set&& s) {
+        auto iter = ids.find(s);
+        if (iter != ids.end()) {
+            return iter->second;
+        }
+        if (sets.size() >= max_states) {
+            flush();
+            iter = ids.find(s);
+            if (iter != ids.end()) {
+                return iter->second;
+            }
+        }
+
+        int id = int(sets.size());
+        auto list_start = accept_all.size();
+        for (auto n : s) {
+            if (nfa_accept[n] != 0) {
+                accept_all.push_back(int(nfa_accept[n]) - 1);
+            }
+        }
+        std::sort(accept_all.begin() + list_start, accept_all.end());
+        accept_all.erase(std::unique(accept_all.begin() + list_start,
+                    accept_all.end()), accept_all.end());
+        accept_start.push_back(int(accept_all.size()));
+        accepts.push_back(accept_all.size() == list_start ? 0 :
+                accept_all[list_start] + 1);
+        // nothing leaves the dead state
+        transitions.resize(transitions.size() + nfa_class_count, id == 0 ? 0 : -1);
+        ids.emplace(s, id);
+        sets.push_back(std::move(s));
+        return id;
+    }
+};
+## endif
+
+struct pattern_matcher {
+    match_ptr  m;
+    token_type tt;
+    int        index;
+};
+
+## if dispatch.use
+//
+// Patterns that could not be compiled into the DFA.
+//
+// The matchers are immutable once constructed, so they (and all the
+// other tables) can be shared by any number of lexers on any number of
+// threads.
+//
 ## for pat in patterns
-    { std::make_shared<<%pat.matcher%>>( <%pat.pattern%> <%pat.flags%> ), <%pat.token%> },
-##endfor
+// <% pat.reason %>
+<%pat.storage%> <%pat.matcher%> pattern_<%pat.index%>{ <%pat.pattern%> <%pat.flags%> };
+## endfor
+
+constexpr pattern_matcher patterns[] = {
+## for pat in patterns
+    { &pattern_<%pat.index%>, <%pat.token%>, <%pat.index%> },
+## endfor
+};
+
+// First byte dispatch for `patterns`. The entries that can match
+// starting with byte c are
+//    patterns[dispatch_list[dispatch_start[c]]] ...
+//    patterns[dispatch_list[dispatch_start[c+1]-1]]
+constexpr <% dispatch.start_type %> dispatch_start[257] = {
+## for row in dispatch.start
+    <% row %>
+## endfor
 };
 
+constexpr <% dispatch.list_type %> dispatch_list[] = {
+## for row in dispatch.list
+    <% row %>
+## endfor
+};
+## endif
+
+## if length(keywords) > 0
+//
+// Keywords that are found by looking up the lexeme of the identifier
+// pattern that matched, rather than by matching them. Each table is a
+// perfect hash of the keywords for one pattern.
+//
+struct keyword_entry {
+    std::string_view text;
+    token_type       token;
+    bool             fold;
+};
+
+constexpr std::uint32_t keyword_hash(const char *p, std::size_t len,
+        std::uint32_t seed) {
+    std::uint32_t h = 2166136261u ^ seed;
+    for (std::size_t i = 0; i < len; ++i) {
+        auto b = static_cast<unsigned char>(p[i]);
+        if (b >= 'A' and b <= 'Z') {
+            b = static_cast<unsigned char>(b - 'A' + 'a');
+        }
+        h ^= b;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+// The keyword token for the lexeme, or `tt` if it isn't one.
+template <std::size_t N>
+token_type promote_keyword(const keyword_entry (&table)[N], std::uint32_t seed,
+        const char *p, std::size_t len, token_type tt) {
+    const auto &entry = table[keyword_hash(p, len, seed) & (N - 1)];
+    if (entry.text.size() != len or len == 0) {
+        return tt;
+    }
+    if (entry.fold) {
+        for (std::size_t i = 0; i < len; ++i) {
+            if (toupper(entry.text[i]) != toupper(p[i])) {
+                return tt;
+            }
+        }
+    } else if (std::memcmp(entry.text.data(), p, len) != 0) {
+        return tt;
+    }
+    return entry.token;
+}
+
+## for kw in keywords
+constexpr keyword_entry keywords_<%kw.pattern%>[] = {
+## for entry in kw.entries
+    { <%entry.text%>, <%entry.token%>, <%entry.fold%> },
+## endfor
+};
+## endfor
+## endif
+
+/************** input sources *****************/
+//
+// Where a streaming lexer gets its bytes from.
+//
+struct input_source {
+    // Read up to `len` bytes into `buf`. Returns the number of bytes
+    // read - 0 only at the end of the input.
+    virtual std::size_t read(char *buf, std::size_t len) = 0;
+
+    virtual ~input_source() = default;
+};
+
+struct istream_source : input_source {
+    std::istream& strm;
+    explicit istream_source(std::istream& s) : strm{s} {};
+    std::size_t read(char *buf, std::size_t len) override {
+        strm.read(buf, std::streamsize(len));
+        return std::size_t(strm.gcount());
+    }
+};
+
+#if defined(YALR_POSIX_IO)
+struct fd_source : input_source {
+    int fd;
+    explicit fd_source(int f) : fd{f} {};
+    std::size_t read(char *buf, std::size_t len) override {
+        for (;;) {
+            auto n = ::read(fd, buf, len);
+            if (n >= 0) {
+                return std::size_t(n);
+            } else if (errno != EINTR) {
+                throw std::system_error(errno, std::generic_category(),
+                        "read failed");
+            }
+        }
+    }
+};
+#endif
+
+//
+// A read only mapping of a whole file, to be lexed in place.
+// Test it before use - the mapping fails for things that aren't regular
+// files (pipes, terminals) and on systems without mmap. The caller should
+// fall back to streaming the file in that case.
+//
+// The file must not be truncated while it is mapped.
+//
+class mapped_file {
+public:
+    explicit mapped_file(const std::string& path) {
+#if defined(YALR_POSIX_IO)
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return;
+        }
+        struct stat st;
+        if (::fstat(fd, &st) == 0 and S_ISREG(st.st_mode)) {
+            size = std::size_t(st.st_size);
+            if (size == 0) {
+                // can't map nothing - but there is nothing to lex either.
+                valid = true;
+            } else {
+                void *ptr = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (ptr != MAP_FAILED) {
+#  if defined(MADV_SEQUENTIAL)
+                    ::madvise(ptr, size, MADV_SEQUENTIAL);
+#  endif
+                    addr = ptr;
+                    valid = true;
+                }
+            }
+        }
+        ::close(fd);
+#endif
+    }
+
+    mapped_file(const mapped_file&) = delete;
+    mapped_file& operator=(const mapped_file&) = delete;
+
+    ~mapped_file() {
+#if defined(YALR_POSIX_IO)
+        if (addr != nullptr) {
+            ::munmap(addr, size);
+        }
+#endif
+    }
+
+    explicit operator bool() const { return valid; }
+
+    const char *begin() const { return static_cast<const char *>(addr); }
+    const char *end() const { return begin() + size; }
+
+private:
+    void *addr = nullptr;
+    std::size_t size = 0;
+    bool valid = false;
+};
 
 class <%lexerclass%> {
 /***** verbatim lexer.top ********/
@@ -187,49 +1226,247 @@ public:
     bool debug = false;
 #endif
     Lexer(iter_type first, const iter_type last) :
-        current(first), last(last) {
+        current(first == last ? nullptr : &*first),
+        last(current + (last - first)), base(current) {
+    }
+
+    // e.g. over a mapped_file
+    Lexer(const char *first, const char *last) :
+        current(first), last(last), base(first) {
     }
 
+    //
+    // Any contiguous range of char - std::string, std::string_view,
+    // std::vector<char> and the like. The characters are not copied, so
+    // the range must outlive the lexer.
+    //
+    template <typename Range,
+              typename = std::enable_if_t<not std::is_array_v<Range> and
+                  std::is_same_v<char, std::remove_cv_t<std::remove_pointer_t<
+                      decltype(std::data(std::declval<const Range&>()))>>>>>
+    explicit Lexer(const Range& range) :
+        Lexer(std::data(range), std::data(range) + std::size(range)) {
+    }
+
+    //
+    // Read the input from `src` through a buffer of (initially)
+    // `chunk_size` bytes. The buffer only grows if a single token
+    // does not fit in it.
+    //
+    explicit Lexer(input_source& src, std::size_t chunk_size = 64 * 1024) :
+        source(&src), buffer(std::max(chunk_size, std::size_t(16))),
+        lookahead(buffer.size() / 2), source_done(false) {
+        current = last = base = buffer.data();
+    }
+
+## if lexer_contextual
     virtual token_value next_token() {
-        if (current == last) {
-            YALR_LDEBUG( "Returning token eoi\n");
-            return eoi;
-        }
+        return next_token(nullptr);
+    }
 
+    //
+    // Only match the patterns in `valid` (which should include the
+    // skips). If none of them match, every pattern is tried, so that the
+    // parser gets the token that is really there to report an error on.
+    //
+    token_value next_token(const pattern_set *valid) {
+## else
+    virtual token_value next_token() {
+## endif
         token_type ret_type = undef;
         std::size_t max_len = 0;
-        YALR_LDEBUG("current character = '" << *current << "'\n");
-
-        for (const auto &[m, tt] : patterns) {
-            YALR_LDEBUG("Matching for token # " << tt);
-            auto [matched, len] = m->try_match(current, last);
-            if (matched) {
-                YALR_LDEBUG(" length = " << len << "\n");
-                if ( std::size_t(len) > max_len) {
-                    max_len = len;
-                    ret_type = tt;
+
+        // Skips are consumed here, one after the other, until there is a
+        // real token (or the end of input).
+        for (;;) {
+            // Keep enough in the buffer for the std::regex matchers, which
+            // can't say when they needed more input.
+            if (std::size_t(last - current) < lookahead) {
+                refill();
+            }
+            if (current == last) {
+                YALR_LDEBUG( "Returning token eoi\n");
+                return Token{eoi, offset(), 0};
+            }
+
+            ret_type = undef;
+            max_len = 0;
+            // the match (or failure) depended on the end of the buffer
+            bool hit_end = false;
+            YALR_LDEBUG("current character = '" << *current << "'\n");
+
+            // definition order of the pattern that matched
+            int ret_index = -1;
+
+## if lexer.use_dfa
+            {
+                int state = 1;
+                for (auto p = current; p != last; ) {
+                    state = dfa_transitions[state * dfa_class_count +
+                        dfa_byte_class[static_cast<unsigned char>(*p)]];
+                    if (state == 0) {
+                        break;
+                    }
+                    ++p;
+## if lexer.accept_lists
+                    if (dfa_accept[state] != 0) {
+                        for (auto i = dfa_accept_start[state]; i < dfa_accept_start[state+1]; ++i) {
+                            if (valid == nullptr or valid->contains(dfa_accept_list[i])) {
+                                ret_index = dfa_accept_list[i];
+                                max_len = std::size_t(p - current);
+                                break;
+                            }
+                        }
+                    }
+## else
+                    if (dfa_accept[state] != 0) {
+                        ret_index = dfa_accept[state] - 1;
+                        max_len = std::size_t(p - current);
+                    }
+## endif
+                    if (p == last) {
+                        hit_end = true;
+                    }
+                }
+                if (ret_index >= 0) {
+                    ret_type = pattern_tokens[ret_index];
+                    YALR_LDEBUG("DFA matched token # " << ret_type <<
+                        " length = " << max_len << "\n");
                 }
-            } else {
-                YALR_LDEBUG(" - no match\n");
             }
-        }
-        if (max_len == 0) {
-            current = last;
-            return token_value{eoi};
-        } else if (ret_type == skip) {
-            YALR_LDEBUG("recursing due to skip\n");
+## endif
+## if lexer.nfa.use_lazy
+            {
+                int state = lazy_cache.start();
+                for (auto p = current; p != last; ) {
+                    state = lazy_cache.next(state, static_cast<unsigned char>(*p));
+                    if (state == 0) {
+                        break;
+                    }
+                    ++p;
+## if lexer_contextual
+                    if (lazy_cache.accept(state) != 0) {
+                        auto [first, last] = lazy_cache.accept_list(state);
+                        for (auto i = first; i != last; ++i) {
+                            if (valid == nullptr or valid->contains(*i)) {
+                                ret_index = *i;
+                                max_len = std::size_t(p - current);
+                                break;
+                            }
+                        }
+                    }
+## else
+                    if (auto a = lazy_cache.accept(state); a != 0) {
+                        ret_index = a - 1;
+                        max_len = std::size_t(p - current);
+                    }
+## endif
+                    if (p == last) {
+                        hit_end = true;
+                    }
+                }
+                if (ret_index >= 0) {
+                    ret_type = pattern_tokens[ret_index];
+                    YALR_LDEBUG("lazy DFA matched token # " << ret_type <<
+                        " length = " << max_len << "\n");
+                }
+            }
+## endif
+
+## if dispatch.use
+            const auto first = static_cast<unsigned char>(*current);
+            for (auto i = dispatch_start[first]; i < dispatch_start[first+1]; ++i) {
+                const auto &[m, tt, index] = patterns[dispatch_list[i]];
+## if lexer_contextual
+                if (valid != nullptr and not valid->contains(index)) {
+                    continue;
+                }
+## endif
+                YALR_LDEBUG("Matching for token # " << tt);
+                auto [matched, len] = m->try_match(current, last);
+                if (len < 0 or std::size_t(len) == std::size_t(last - current)) {
+                    hit_end = true;
+                }
+                if (matched) {
+                    YALR_LDEBUG(" length = " << len << "\n");
+                    // longest match wins. Ties go to the pattern defined first.
+                    if ( std::size_t(len) > max_len or
+                            (len > 0 and std::size_t(len) == max_len and index < ret_index)) {
+                        max_len = len;
+                        ret_type = tt;
+                        ret_index = index;
+                    }
+                } else {
+                    YALR_LDEBUG(" - no match\n");
+                }
+            }
+## endif
+            if (hit_end and refill()) {
+                YALR_LDEBUG("ran out of buffer - trying again\n");
+                continue;
+            }
+## for kw in keywords
+            if (ret_index == <%kw.pattern%>) {
+                ret_type = promote_keyword(keywords_<%kw.pattern%>, <%kw.seed%>,
+                        current, max_len, ret_type);
+            }
+## endfor
+## if lexer_contextual
+            if (max_len == 0 and valid != nullptr) {
+                YALR_LDEBUG("nothing the parser wants - trying everything\n");
+                valid = nullptr;
+                continue;
+            }
+## endif
+            if (max_len == 0) {
+                // Nothing matched. Report the end of input at the
+                // point we got stuck.
+                Token stuck{eoi, offset(), 0};
+                current = last;
+                return stuck;
+            } else if (ret_type != skip) {
+                break;
+            }
+            YALR_LDEBUG("skipping " << max_len << " characters\n");
             current += max_len;
-            return next_token();
         }
-        std::string lx{current, current+max_len};
+
+## if length(semantic_actions) > 0
+        // the lexeme, for the terms with values
+        const char *lx = current;
+## endif
+        Token tok{ret_type, offset(), std::uint32_t(max_len)};
         current += max_len;
         semantic_value ret_sval;
         switch (ret_type) {
 ## for sa in semantic_actions 
             case <%sa.token%> : {
-                    auto block = [](std::string&& lexeme) -> <%sa.type%>
+## if sa.builtin == "atom"
+## if lexer_parallel
+                    if (defer_atoms) {
+                        ret_sval = make_value<atom>(atom{atom::none, std::string_view{lx, max_len}});
+                        break;
+                    }
+## endif
+                    ret_sval = make_value<atom>(atoms.intern(std::string_view{lx, max_len}));
+## else if sa.builtin != ""
+                    <%sa.type%> value;
+                    if (auto msg = lexeme_to_number(lx, max_len, value)) {
+                        last_error = lex_error{tok.offset, tok.length, msg};
+                        YALR_LDEBUG("bad @<%sa.builtin%> - " << msg << "\n");
+                        return Token{undef, tok.offset, tok.length};
+                    }
+                    ret_sval = make_value<<%sa.type%>>(value);
+## else
+                    auto block = [](<% lexeme_param %> lexeme) -> <%sa.type%>
                     {  <%sa.block%> };
-                    ret_sval = block(std::move(lx));
+## if lexeme_view
+                    // Points into the input - no copy is made.
+                    ret_sval = make_value<<%sa.type%>>(block(std::string_view{lx, max_len}));
+## else
+                    ret_sval = make_value<<%sa.type%>>(block(std::string{lx, max_len}));
+## endif
+## endif
                 }
                 break;
 ## endfor
@@ -239,14 +1476,310 @@ public:
         }
 
         YALR_LDEBUG( "Returning token = " << ret_type << "\n");
-        return token_value{ret_type, ret_sval};
+        return token_value{tok, std::move(ret_sval)};
+    }
+
+    //
+    // Lex up to `max_tokens` tokens onto the end of `buf`, stopping after
+    // eoi. Returns the number added. Calls this class's next_token()
+    // directly, so there is no virtual call per token.
+    //
+    std::size_t lex_into(token_buffer& buf,
+            std::size_t max_tokens = std::size_t(-1)) {
+        std::size_t count = 0;
+        while (count < max_tokens) {
+            auto tv = <%lexerclass%>::next_token();
+            auto type = tv.t.toktype;
+            buf.push_back(std::move(tv));
+            ++count;
+            if (type == eoi) {
+                break;
+            }
+        }
+        return count;
+    }
+
+## if lexer_parallel
+    //
+    // Lex all of [first, last) into `buf` using up to `threads` threads
+    // (0 means one per core). The tokens are exactly what lex_into() would
+    // give. Inputs smaller than `min_chunk` bytes per thread use fewer
+    // threads.
+    //
+    // Each chunk is lexed as though a token started at its first byte.
+    // That guess is then checked in order: the real token stream is lexed
+    // on from where the previous chunk left off until it reaches a token
+    // that the chunk also found. From there on the two agree, since what
+    // is matched only depends on where it starts.
+    //
+## if has_atoms
+    // The @atom values are left with an id of atom::none and their text
+    // in the input. Use the overload below to intern them.
+    //
+## endif
+    static void lex_parallel(token_buffer& buf, const char *first,
+            const char *last, unsigned threads = 0,
+            std::size_t min_chunk = std::size_t(1) << 20) {
+        if (threads == 0) {
+            threads = std::max(1u, std::thread::hardware_concurrency());
+        }
+        auto size = std::uint64_t(last - first);
+        auto chunks = std::size_t(std::min<std::uint64_t>(threads,
+                    size / std::max(min_chunk, std::size_t(1))));
+        if (chunks < 2) {
+            <%lexerclass%> lexer(first, first, last);
+            lexer.lex_into(buf);
+            return;
+        }
+
+        std::vector<std::uint64_t> starts(chunks + 1);
+        for (std::size_t k = 0; k < chunks; ++k) {
+            starts[k] = size * k / chunks;
+        }
+        starts[chunks] = UINT64_MAX;
+
+        std::vector<std::future<chunk_result>> futures;
+        for (std::size_t k = 1; k < chunks; ++k) {
+            futures.push_back(std::async(std::launch::async, lex_chunk,
+                        first, starts[k], starts[k+1], last));
+        }
+
+        auto head = lex_chunk(first, 0, starts[1], last);
+        bool done = head.at_end;
+        std::uint64_t resume = head.resume;
+        buf.append(head.tokens);
+
+        for (std::size_t k = 1; k < chunks; ++k) {
+            auto chunk = futures[k-1].get();
+            if (done) {
+                continue;
+            }
+            if (resume == starts[k]) {
+                buf.append(chunk.tokens);
+                resume = chunk.resume;
+                done = chunk.at_end;
+                continue;
+            }
+            <%lexerclass%> lexer(first, first + resume, last);
+            for (;;) {
+                auto before = lexer.offset();
+                auto tv = lexer.<%lexerclass%>::next_token();
+                if (tv.t.offset >= starts[k+1]) {
+                    resume = before;
+                    break;
+                }
+                const auto &offsets = chunk.tokens.offsets;
+                auto iter = std::lower_bound(offsets.begin(), offsets.end(), tv.t.offset);
+                if (iter != offsets.end() and *iter == tv.t.offset) {
+                    buf.append(chunk.tokens, std::size_t(iter - offsets.begin()));
+                    resume = chunk.resume;
+                    done = chunk.at_end;
+                    break;
+                }
+                bool at_end = (tv.t.toktype == eoi);
+                buf.push_back(std::move(tv));
+                if (at_end) {
+                    done = true;
+                    break;
+                }
+            }
+        }
+    }
+
+## if has_atoms
+    //
+    // As above, then intern the @atom values into `pool`. This is done on
+    // the calling thread once the chunks have been put together.
+    //
+    static void lex_parallel(token_buffer& buf, symbol_pool& pool,
+            const char *first, const char *last, unsigned threads = 0,
+            std::size_t min_chunk = std::size_t(1) << 20) {
+        auto from = buf.size();
+        lex_parallel(buf, first, last, threads, min_chunk);
+        for (auto i = from; i < buf.size(); ++i) {
+            if (auto *a = value_if<atom>(buf.values[i])) {
+                *a = pool.intern(a->text);
+            }
+        }
+    }
+
+## endif
+## endif
+    // Offset in the input of the next character to be lexed.
+    std::uint64_t offset() const {
+        return base_offset + std::uint64_t(current - base);
+    }
+
+    //
+    // Line and column of an offset that has already been lexed (e.g. a
+    // Token's offset). The newlines are found the first time they are
+    // needed, so there is no cost unless this is used. Streaming input
+    // records them as the buffer is refilled instead, before the bytes are
+    // thrown away.
+    //
+    source_location location(std::uint64_t off) {
+        index_lines(off);
+        // newlines before the offset
+        auto iter = std::lower_bound(newlines.begin(), newlines.end(), off);
+        std::uint64_t line = std::uint64_t(iter - newlines.begin()) + 1;
+        std::uint64_t line_start = (iter == newlines.begin() ? 0 : *(iter - 1) + 1);
+        return { line, off - line_start + 1 };
+    }
+
+## if lexer.nfa.use_lazy
+    //
+    // Bound the number of DFA states the lexer keeps. The cache starts
+    // over empty.
+    //
+    void lazy_cache_size(std::size_t states) {
+        lazy_cache = lazy_dfa{states};
     }
 
+    const lazy_dfa& lazy_dfa_cache() const { return lazy_cache; }
+
+## endif
+## if has_atoms
+    // The @atom lexemes seen so far.
+    symbol_pool& symbols() { return atoms; }
+    const symbol_pool& symbols() const { return atoms; }
+
+## endif
+    // The last token that could not be converted to its value, if any.
+    const std::optional<lex_error>& error() const { return last_error; }
+
     // Just needed to make it virtual
     virtual ~Lexer() = default;
 private:
-    std::string::const_iterator current;
-    const std::string::const_iterator last;
+## if lexer_parallel
+    // Lex from `start`, with offsets counted from `first`.
+    <%lexerclass%>(const char *first, const char *start, const char *last) :
+        current(start), last(last), base(first) {
+## if has_atoms
+        // The chunk lexers don't live long enough to own the text.
+        defer_atoms = true;
+## endif
+    }
+
+    struct chunk_result {
+        token_buffer tokens;
+        // offset the next token would be lexed from
+        std::uint64_t resume = 0;
+        // tokens ends with eoi
+        bool at_end = false;
+    };
+
+    //
+    // The tokens that start in [start, stop) when lexing from `start`.
+    //
+    static chunk_result lex_chunk(const char *first, std::uint64_t start,
+            std::uint64_t stop, const char *last) {
+        <%lexerclass%> lexer(first, first + start, last);
+        chunk_result retval;
+        for (;;) {
+            retval.resume = lexer.offset();
+            auto tv = lexer.<%lexerclass%>::next_token();
+            if (tv.t.offset >= stop) {
+                break;
+            }
+            bool at_end = (tv.t.toktype == eoi);
+            retval.tokens.push_back(std::move(tv));
+            if (at_end) {
+                retval.resume = lexer.offset();
+                retval.at_end = true;
+                break;
+            }
+        }
+        return retval;
+    }
+
+## endif
+private:
+    const char *current;
+    const char *last;
+
+    // The start of the buffer (or the in memory input) and its offset
+    // in the input.
+    const char *base;
+    std::uint64_t base_offset = 0;
+
+    std::optional<lex_error> last_error;
+
+## if has_atoms
+    symbol_pool atoms;
+## if lexer_parallel
+    // Leave @atom values uninterned, with their text in the input.
+    bool defer_atoms = false;
+## endif
+
+## endif
+    // Streaming input only
+    input_source *source = nullptr;
+    std::vector<char> buffer;
+    std::size_t lookahead = 0;
+    bool source_done = true;
+
+## if lexer.nfa.use_lazy
+    lazy_dfa lazy_cache;
+
+## endif
+    // Offsets of the newlines before indexed_to.
+    std::vector<std::uint64_t> newlines;
+    std::uint64_t indexed_to = 0;
+
+    void index_lines(std::uint64_t upto) {
+        upto = std::min(upto, base_offset + std::uint64_t(last - base));
+        if (indexed_to >= upto) {
+            return;
+        }
+        const char *p = base + (indexed_to - base_offset);
+        const char *end = base + (upto - base_offset);
+        while (p != end) {
+            auto nl = static_cast<const char *>(std::memchr(p, '\n', std::size_t(end - p)));
+            if (nl == nullptr) {
+                break;
+            }
+            newlines.push_back(base_offset + std::uint64_t(nl - base));
+            p = nl + 1;
+        }
+        indexed_to = upto;
+    }
+
+    //
+    // Move what hasn't been lexed yet to the front of the buffer and fill
+    // the rest from the source. Doubles the buffer if it is already full.
+    // Returns false if there was nothing left to read.
+    //
+    bool refill() {
+        if (source_done) {
+            return false;
+        }
+
+        // the bytes before current are about to be gone
+        index_lines(offset());
+
+        auto keep = std::size_t(last - current);
+        base_offset += std::uint64_t(current - base);
+        if (keep > 0 and current != buffer.data()) {
+            std::memmove(buffer.data(), current, keep);
+        }
+        if (keep == buffer.size()) {
+            buffer.resize(buffer.size() * 2);
+        }
+
+        while (keep < buffer.size()) {
+            auto count = source->read(buffer.data() + keep, buffer.size() - keep);
+            if (count == 0) {
+                source_done = true;
+                break;
+            }
+            keep += count;
+        }
+
+        current = base = buffer.data();
+        last = current + keep;
+
+        return true;
+    }
 
 /***** verbatim lexer.bottom ********/
 ## for v in verbatim.lexer_bottom
@@ -255,11 +1788,121 @@ private:
 /***** verbatim lexer.bottom ********/
 };
 
+## if code_parser
+
+//
+// Bump allocated memory for what the semantic actions build (an AST, say).
+// Nothing made here is freed on its own. Everything is destroyed, newest
+// first, and the memory handed back in one go when the arena is cleared
+// or destroyed.
+//
+class parse_arena {
+    struct dtor_node {
+        void *obj;
+        void (*destroy)(void *);
+        dtor_node *next;
+    };
+
+    std::pmr::monotonic_buffer_resource pool;
+    dtor_node *dtors = nullptr;
+
+public:
+    explicit parse_arena(std::pmr::memory_resource *upstream =
+            std::pmr::get_default_resource()) : pool(upstream) {}
+    parse_arena(const parse_arena&) = delete;
+    parse_arena& operator=(const parse_arena&) = delete;
+    ~parse_arena() { clear(); }
+
+    template <typename T, typename... Args>
+    T *make(Args&&... args) {
+        dtor_node *node = nullptr;
+        if constexpr (not std::is_trivially_destructible_v<T>) {
+            node = static_cast<dtor_node *>(
+                    pool.allocate(sizeof(dtor_node), alignof(dtor_node)));
+        }
+        auto *retval = ::new (pool.allocate(sizeof(T), alignof(T)))
+            T(std::forward<Args>(args)...);
+        if (node != nullptr) {
+            *node = dtor_node{ retval,
+                [](void *p) { static_cast<T *>(p)->~T(); }, dtors };
+            dtors = node;
+        }
+        return retval;
+    }
+
+    // For containers in the nodes, e.g. std::pmr::vector<Node *>
+    std::pmr::memory_resource *resource() { return &pool; }
+
+    void clear() {
+        for (auto *n = dtors; n != nullptr; n = n->next) {
+            n->destroy(n->obj);
+        }
+        dtors = nullptr;
+        pool.release();
+    }
+};
+
+//
+// The parser's stack of symbols and their values. It is contiguous, grows
+// by doubling and is only cleared between parses, never shrunk. Handing it
+// from one parse to the next (Parser::release_stack() and adopt_stack())
+// means parsing stops allocating once it is big enough.
+//
+using parse_stack = std::pmr::vector<token_value>;
 
 class <%parserclass%> {
-    Lexer& lexer;
+    <%lexerclass%>& lexer;
+    // Where the stacks get their memory
+    std::pmr::memory_resource *memory;
     token_value la;
-    std::deque<token_value> tokstack;
+    parse_stack tokstack{memory};
+    std::unique_ptr<parse_arena> nodes;
+
+    // How deep the stack may get before the parse fails. No limit unless
+    // max_depth() sets one.
+    std::size_t depth_limit = SIZE_MAX;
+    bool too_deep = false;
+
+    // Pre-lexed input. If window is not 0, the buffer is refilled with
+    // that many tokens at a time as the parser uses them up.
+    token_buffer *tokens = nullptr;
+    std::size_t next_index = 0;
+    std::size_t window = 0;
+
+## if lexer_contextual
+    // The patterns that can come next in each state.
+    static constexpr pattern_set state_patterns[] = {
+## for row in state_patterns.rows
+        <% row %>
+## endfor
+    };
+
+## endif
+    //
+    // The next token, to be handled by `state`. Pre-lexed tokens were
+    // lexed without knowing the state.
+    //
+    token_value next_token([[maybe_unused]] int state) {
+        if (tokens == nullptr) {
+## if lexer_contextual
+            return lexer.next_token(&state_patterns[state]);
+## else
+            return lexer.next_token();
+## endif
+        }
+        if (next_index == tokens->size()) {
+            if (window == 0) {
+                return Token{eoi, lexer.offset(), 0};
+            }
+            tokens->clear();
+            next_index = 0;
+            if (lexer.lex_into(*tokens, window) == 0) {
+                return Token{eoi, lexer.offset(), 0};
+            }
+        }
+        auto i = next_index++;
+        return token_value{tokens->token(i), std::move(tokens->values[i])};
+    }
 
     void printstack() {
         value_printer vp;
@@ -271,20 +1914,49 @@ class <%parserclass%> {
         }
         std::cerr << "\n";
     }
-    void shift() {
+    //
+    // Returns false, without shifting, if the stack is already as deep as
+    // it is allowed to get.
+    //
+    bool shift(int new_state) {
+        if (tokstack.size() >= depth_limit) {
+            YALR_PDEBUG("Stack limit of " << depth_limit << " reached\n");
+            too_deep = true;
+            return false;
+        }
         YALR_PDEBUG("Shifting " << la.t.toktype << "\n");
-        tokstack.push_back(la);
+        push(std::move(la));
 #if defined(YALR_DEBUG)
         if (debug) printstack();
 #endif
-        la = lexer.next_token();
+        la = next_token(new_state);
+        return true;
+    }
+
+    //
+    // The token for a rule covers everything it was reduced from.
+    //
+    Token rule_token(token_type sym, int count) const {
+        if (count == 0) {
+            return Token{sym, la.t.offset, 0};
+        }
+        const auto& first = tokstack[tokstack.size() - count].t;
+        const auto& last = tokstack.back().t;
+        auto len = last.offset + last.length - first.offset;
+        return Token{sym, first.offset,
+            std::uint32_t(std::min<std::uint64_t>(len, UINT32_MAX))};
+    }
+
+    void push(token_value&& tv) {
+        if (tokstack.size() == tokstack.capacity()) {
+            tokstack.reserve(std::max(tokstack.capacity() * 2, std::size_t(64)));
+        }
+        tokstack.push_back(std::move(tv));
     }
 
     void reduce(int i) {
         YALR_PDEBUG("Popping " << i << " items\n");
-        for(; i>0; --i) {
-            tokstack.pop_back();
-        }
+        tokstack.erase(tokstack.end() - i, tokstack.end());
     }
 /***** verbatim parser.top ********/
 ## for v in verbatim.parser_top
@@ -292,7 +1964,94 @@ class <%parserclass%> {
 ## endfor
 /***** verbatim parser.top ********/
 /************** states *****************/
+## if parser_style == "trampoline"
+
+    //
+    // The same code per state as the recursive style, but each state
+    // hands back to one loop rather than calling the next. The states
+    // are kept on an explicit stack, so the C++ stack stays the same
+    // depth however deep the input nests.
+    //
+    std::pmr::vector<int> state_stack{memory};
+
+    int goto_state(int state, token_type sym) {
+        switch (state) {
+## for state in states
+## if length(state.gotos) > 0
+            case <%state.id%> :
+                switch (sym) {
+## for goto in state.gotos
+                    case <%goto.symbol%> : return <%goto.stateid%>;
+## endfor
+                    default : break;
+                }
+                break;
+## endif
+## endfor
+            default : break;
+        }
+        return -1;
+    }
+
+    bool trampoline_parse() {
+        state_stack.clear();
+        state_stack.push_back(0);
+        la = next_token(0);
+
+        for (;;) {
+            // set by a reduce
+            token_type sym = undef;
+            int count = 0;
+
+            switch (state_stack.back()) {
+## for state in states
+            case <%state.id%> :
+                YALR_PDEBUG("entering state <%state.id%>\n");
+                switch (la.t.toktype) {
+## for action in state.actions
+                    case <%action.token%> :
+                    {% if action.type == "shift" %}
+                        if (not shift(<%action.newstateid%>)) {
+                            return false;
+                        }
+                        state_stack.push_back(<%action.newstateid%>);
+                        continue;
+                    {% else if action.type == "reduce" %}
+                        {% if action.hassemaction == "Y" %}
+                        {
+                            auto tok = rule_token(<%action.symbol%>, <%action.count%>);
+                            push({tok, reduce_by_prod<%action.prodid%>()});
+                        }
+                        {% else %}
+                        YALR_PDEBUG( "Reducing by : <%action.production%>\n");
+                        {
+                            auto tok = rule_token(<%action.symbol%>, <%action.count%>);
+                            reduce(<%action.count%>);
+                            push(tok);
+                        }
+                        {% endif %}
+                        sym = <%action.symbol%>;
+                        count = <%action.count%>;
+                        break;
+                    {% else %}
+                        return true;
+                    {% endif %}
+## endfor
+                    default : return false;
+                }
+                break;
+## endfor
+            }
 
+            YALR_PDEBUG("Shifting " << sym << "\n");
+#if defined(YALR_DEBUG)
+            if (debug) printstack();
+#endif
+            state_stack.resize(state_stack.size() - std::size_t(count));
+            state_stack.push_back(goto_state(state_stack.back(), sym));
+        }
+    }
+## else
 ## for state in states
 
     rettype state<%state.id%>() {
@@ -304,16 +2063,25 @@ class <%parserclass%> {
 ## for action in state.actions
             case <%action.token%> :
             {% if action.type == "shift" %}
-                shift(); retval = state<%action.newstateid%>();
+                if (not shift(<%action.newstateid%>)) {
+                    return { state_action::error };
+                }
+                retval = state<%action.newstateid%>();
             {% else if action.type == "reduce" %}
                 {% if action.hassemaction == "Y" %}
-                tokstack.push_back({<%action.symbol%>, reduce_by_prod<%action.prodid%>()});
+                {
+                    auto tok = rule_token(<%action.symbol%>, <%action.count%>);
+                    push({tok, reduce_by_prod<%action.prodid%>()});
+                }
                 YALR_PDEBUG("Shifting " << <%action.symbol%> << "\n");
                 {% else %}
                 YALR_PDEBUG( "Reducing by : <%action.production%>\n");
-                reduce(<%action.count%>);
-                YALR_PDEBUG("Shifting " << <%action.symbol%> << "\n");
-                tokstack.push_back(<%action.symbol%>);
+                {
+                    auto tok = rule_token(<%action.symbol%>, <%action.count%>);
+                    reduce(<%action.count%>);
+                    YALR_PDEBUG("Shifting " << <%action.symbol%> << "\n");
+                    push(tok);
+                }
                 {% endif %}
 #if defined(YALR_DEBUG)
                 if (debug) printstack();
@@ -349,22 +2117,26 @@ class <%parserclass%> {
         return retval;
     }
 ## endfor
+## endif
 /************** end states *****************/
 
 /************** reduce functions *****************/
 ## for func in reducefuncs
     semantic_value reduce_by_prod<%func.prodid%>() {
         YALR_PDEBUG( "Reducing by : <%func.production%>\n");
+        [[maybe_unused]] auto base = tokstack.size() - <% length(func.itemtypes) %>;
 ## for type in func.itemtypes
+        [[maybe_unused]] const Token _t<%type.index%> = tokstack[base + <%type.index%> - 1].t;
 ## if type.type != "void"
-        auto _v<%type.index%> = std::get<<%type.type%>>(tokstack.back().v);
+        // moved off the stack - not copied
+        auto _v<%type.index%> = take_value<<%type.type%>>(tokstack[base + <%type.index%> - 1].v);
 ## endif
 ## if type.alias != ""
         auto &<%type.alias%> = _v<%type.index%>;
 ## endif
-        tokstack.pop_back();
 
 ## endfor
+        tokstack.erase(tokstack.begin() + std::ptrdiff_t(base), tokstack.end());
         auto block = [&]() {
             <%func.block%>
         };
@@ -372,28 +2144,232 @@ class <%parserclass%> {
         block();
         return {};
 ## else
-        return block();
+        return make_value<<%func.rule_type%>>(block());
 ## endif
     }
 ## endfor
 /************** end reduce functions *****************/
+## if parser_style == "table"
+
+/************** parse tables *****************/
+    using action_type = <% parse_tables.action_type %>;
+    using state_type = <% parse_tables.state_type %>;
+
+    static constexpr int term_count = <% parse_tables.term_count %>;
+    static constexpr int rule_count = <% parse_tables.rule_count %>;
+    static constexpr action_type accept_action = <% parse_tables.accept %>;
+
+    // token value -> column in the action (terms) or goto (rules) table
+    static constexpr <% parse_tables.column_type %> columns[] = {
+## for row in parse_tables.columns
+        <% row %>
+## endfor
+    };
+
+    // 0 - error, > 0 - shift to state - 1, < 0 reduce by -production - 1
+    static constexpr action_type actions[] = {
+## for row in parse_tables.actions
+        <% row %>
+## endfor
+    };
+
+    // row of actions[] for each state
+    static constexpr <% parse_tables.row_type %> action_row[] = {
+## for row in parse_tables.action_row
+        <% row %>
+## endfor
+    };
+
+    static constexpr state_type gotos[] = {
+## for row in parse_tables.gotos
+        <% row %>
+## endfor
+    };
+
+    // row of gotos[] for each state
+    static constexpr <% parse_tables.row_type %> goto_row[] = {
+## for row in parse_tables.goto_row
+        <% row %>
+## endfor
+    };
+
+    // the rule and length of each production
+    static constexpr int prod_symbol[] = {
+## for row in parse_tables.prod_symbol
+        <% row %>
+## endfor
+    };
+
+    static constexpr int prod_length[] = {
+## for row in parse_tables.prod_length
+        <% row %>
+## endfor
+    };
+
+    std::pmr::vector<state_type> state_stack{memory};
+
+    action_type action_for(state_type state, token_type tok) const {
+        if (tok < 0 or std::size_t(tok) >= std::size(columns)) {
+            return 0;
+        }
+        auto col = columns[tok];
+        if (col < 0) {
+            return 0;
+        }
+        return actions[std::size_t(action_row[state]) * term_count + std::size_t(col)];
+    }
+
+    // The value left by the production's action, if it has one.
+    semantic_value run_reduce(int prod) {
+        switch (prod) {
+## for func in reducefuncs
+            case <%func.prodid%> : return reduce_by_prod<%func.prodid%>();
+## endfor
+            default :
+                reduce(prod_length[prod]);
+                return {};
+        }
+    }
+
+    //
+    // The LR automaton as a loop over an explicit stack of states rather
+    // than a function per state.
+    //
+    bool table_parse() {
+        state_stack.clear();
+        state_stack.push_back(0);
+        la = next_token(0);
+
+        for (;;) {
+            auto state = state_stack.back();
+            auto action = action_for(state, la.t.toktype);
+            if (action > 0) {
+                state_type new_state = state_type(action - 1);
+                if (not shift(new_state)) {
+                    return false;
+                }
+                state_stack.push_back(new_state);
+            } else if (action == accept_action) {
+                return true;
+            } else if (action < 0) {
+                int prod = -action - 1;
+                int count = prod_length[prod];
+                auto sym = token_type(prod_symbol[prod]);
+                YALR_PDEBUG("Reducing by production " << prod << "\n");
+                auto tok = rule_token(sym, count);
+                auto value = run_reduce(prod);
+                push({tok, std::move(value)});
+                state_stack.resize(state_stack.size() - std::size_t(count));
+                auto from = state_stack.back();
+                state_stack.push_back(gotos[std::size_t(goto_row[from]) * rule_count +
+                        std::size_t(columns[sym])]);
+                YALR_PDEBUG("Shifting " << sym << "\n");
+#if defined(YALR_DEBUG)
+                if (debug) printstack();
+#endif
+            } else {
+                return false;
+            }
+        }
+    }
+/************** end parse tables *****************/
+## endif
 
 public:
 #if defined(YALR_DEBUG)
     bool debug = false;
 #endif
-    <%parserclass%>(<%lexerclass%>& l) : lexer(l){};
+    //
+    // The stacks and the arena() take their memory from `mr`, e.g. a
+    // std::pmr::monotonic_buffer_resource that lives as long as the parser.
+    //
+    <%parserclass%>(<%lexerclass%>& l,
+            std::pmr::memory_resource *mr = std::pmr::get_default_resource()) :
+        lexer(l), memory(mr) {};
+
+    // Parse tokens that have already been lexed into `buf`.
+    <%parserclass%>(<%lexerclass%>& l, token_buffer& buf,
+            std::pmr::memory_resource *mr = std::pmr::get_default_resource()) :
+        lexer(l), memory(mr), tokens(&buf) {};
+
+    // Lex `window` tokens at a time into `buf` and parse from there.
+    <%parserclass%>(<%lexerclass%>& l, token_buffer& buf, std::size_t w,
+            std::pmr::memory_resource *mr = std::pmr::get_default_resource()) :
+        lexer(l), memory(mr), tokens(&buf), window(w) {};
 
     bool doparse() {
-        la = lexer.next_token();
+        too_deep = false;
+        tokstack.clear();
+## if parser_style == "table"
+        return table_parse();
+## else if parser_style == "trampoline"
+        return trampoline_parse();
+## else
+        la = next_token(0);
         auto retval = state0();
         if (retval.action == accept) {
             return true;
         }
 
         return false;
+## endif
     }
 
+    //
+    // Fail the parse, rather than run out of stack (or memory), once the
+    // stack holds more than `depth` symbols. The recursive style has a C++
+    // stack frame per symbol - about 110 bytes for a small grammar.
+    //
+    void max_depth(std::size_t depth) { depth_limit = depth; }
+
+    // Did the last parse fail because it hit max_depth()?
+    bool depth_exceeded() const { return too_deep; }
+
+    // Make room for `n` symbols on the stack up front.
+    void reserve_stack(std::size_t n) { tokstack.reserve(n); }
+
+    //
+    // Hand the stack (emptied, but with its memory) to another parser, or
+    // take one from a parser that is done with it.
+    //
+    parse_stack release_stack() {
+        tokstack.clear();
+        return std::move(tokstack);
+    }
+
+    // A stack using another memory resource is not taken over, only
+    // emptied.
+    void adopt_stack(parse_stack&& stack) {
+        tokstack = std::move(stack);
+        tokstack.clear();
+    }
+
+    //
+    // Where the semantic actions allocate what they build -
+    // `arena().make<Node>(...)`. It is not cleared between parses. Whatever
+    // was made is freed with the parser, or with the arena once it has
+    // been released to go along with the result. The arena gets its memory
+    // from the resource given to the parser, so it must not outlive it.
+    //
+    parse_arena& arena() {
+        if (not nodes) {
+            nodes = std::make_unique<parse_arena>(memory);
+        }
+        return *nodes;
+    }
+
+    // Take the arena (and so everything made in it) away from the parser.
+    // It may outlive the parser, but not the parser's memory resource.
+    // The next call to arena() starts a new one.
+    std::unique_ptr<parse_arena> release_arena() {
+        return std::move(nodes);
+    }
+
+## if has_atoms
+    // The @atom lexemes interned for this parse.
+    const symbol_pool& symbols() const { return lexer.symbols(); }
+
+## endif
 /***** verbatim parser.bottom ********/
 ## for v in verbatim.parser_bottom
 <% v %>
@@ -402,6 +2378,8 @@ public:
 
 }; // class <%parserclass%>
 
+## endif
+
 /***** verbatim namespace.bottom ********/
 ## for v in verbatim.namespace_bottom
 <% v %>
@@ -13,6 +13,14 @@ int main(int argc, char*argv[]) {
     bool parser_debug = false;
     bool lexer_debug = false;
     bool input_is_file = false;
+    // -w : pre-lex the input into a token_buffer, this many tokens at a
+    // time (0 means all of it) before the parser sees it.
+    bool prelex = false;
+    std::size_t window = 0;
+    // -j : pre-lex all of the input on this many threads (0 means one per
+    // core). Only if the grammar set lexer.parallel.
+    bool parallel = false;
+    unsigned threads = 0;
     std::string input = "";
 
     while (argc > current_arg) {
@@ -27,6 +35,26 @@ int main(int argc, char*argv[]) {
             parser_debug = true;
             lexer_debug = true;
             current_arg += 1;
+       } else if (std::string("-w").compare(argv[current_arg]) == 0) {
+            current_arg += 1;
+            if (argc > current_arg) {
+               prelex = true;
+               window = std::stoul(argv[current_arg]);
+               current_arg += 1;
+            } else {
+                std::cerr << "Window size must be given for the -w option\n";
+                exit(1);
+            }
+       } else if (std::string("-j").compare(argv[current_arg]) == 0) {
+            current_arg += 1;
+            if (argc > current_arg) {
+               parallel = true;
+               threads = unsigned(std::stoul(argv[current_arg]));
+               current_arg += 1;
+            } else {
+                std::cerr << "Thread count must be given for the -j option\n";
+                exit(1);
+            }
        } else if (std::string("-f").compare(argv[current_arg]) == 0) {
             current_arg += 1;
             if (argc > current_arg) {
@@ -52,42 +80,134 @@ int main(int argc, char*argv[]) {
         exit(1);
     }
 
+    //
+    // Files are lexed in place if they can be mapped. Otherwise they are
+    // read through the lexer's buffer rather than all at once.
+    //
+    std::unique_ptr<YalrParser::mapped_file> mapping;
+    std::ifstream fstrm;
+    std::unique_ptr<YalrParser::input_source> source;
     if (input_is_file) {
         if (input == "-") {
-            std::ostringstream os;
-            os << std::cin.rdbuf();
-            input = os.str();
+#if defined(YALR_POSIX_IO)
+            source = std::make_unique<YalrParser::fd_source>(0);
+#else
+            source = std::make_unique<YalrParser::istream_source>(std::cin);
+#endif
         } else {
-            // slurp the entire file back into input
-            //
-            std::ifstream fstrm{input};
-            if (fstrm) {
-                std::ostringstream os;
-                os << fstrm.rdbuf();
-                input = os.str();
-            } else {
-                std::cerr << "Failed to open file '" << input << "'\n";
-                exit(1);
+            mapping = std::make_unique<YalrParser::mapped_file>(input);
+            if (not *mapping) {
+                mapping.reset();
+                fstrm.open(input, std::ios::binary);
+                if (fstrm) {
+                    source = std::make_unique<YalrParser::istream_source>(fstrm);
+                } else {
+                    std::cerr << "Failed to open file '" << input << "'\n";
+                    exit(1);
+                }
             }
         }
     }
+#if defined(YALR_LEXEME_VIEW)
+    //
+    // The lexemes handed to the actions point into the input, and a
+    // source moves its buffer along as it refills. So read it all.
+    //
+    if (source) {
+        std::istream &strm = (fstrm.is_open() ? static_cast<std::istream&>(fstrm) : std::cin);
+        input.assign(std::istreambuf_iterator<char>(strm), std::istreambuf_iterator<char>());
+        source.reset();
+    }
+#endif
+
+    std::unique_ptr<YalrParser::Lexer> lexer;
+    if (mapping) {
+        lexer = std::make_unique<YalrParser::Lexer>(mapping->begin(), mapping->end());
+    } else if (source) {
+        lexer = std::make_unique<YalrParser::Lexer>(*source);
+    } else {
+        lexer = std::make_unique<YalrParser::Lexer>(input);
+    }
+#if defined(YALR_DEBUG)
+    lexer->debug = lexer_debug;
+#endif
+
+    YalrParser::token_buffer tokens;
+#if defined(YALR_PARALLEL_LEX)
+    if (parallel and not source) {
+        const char *first = (mapping ? mapping->begin() : input.data());
+        const char *last = (mapping ? mapping->end() : input.data() + input.size());
+#  if defined(YALR_ATOMS)
+        YalrParser::Lexer::lex_parallel(tokens, lexer->symbols(), first, last, threads);
+#  else
+        YalrParser::Lexer::lex_parallel(tokens, first, last, threads);
+#  endif
+    }
+#else
+    (void)threads;
+    if (parallel) {
+        std::cerr << "-j needs the grammar to set lexer.parallel\n";
+        exit(1);
+    }
+#endif
+    // From here on, parallel means all of the tokens are already lexed.
+    parallel = not tokens.empty();
 
-    YalrParser::Lexer lexer(input.cbegin(), input.cend());
-    lexer.debug = lexer_debug;
+)xx";
 
-    auto parser = YalrParser::Parser(lexer);
+const std::string gen_main_parse_code = R"xx(
+    if (prelex and window == 0 and not parallel) {
+        lexer->lex_into(tokens);
+    }
+    auto parser = (not (prelex or parallel) ? YalrParser::Parser(*lexer) :
+            YalrParser::Parser(*lexer, tokens, (parallel ? 0 : window)));
+#if defined(YALR_DEBUG)
     parser.debug = parser_debug;
+#endif
 
     if (parser.doparse()) {
         //std::cout << "Input matches grammar!\n";
         return 0;
     } else {
+        if (const auto& err = lexer->error()) {
+            std::cout << "Lexer error at offset " << err->offset << ": " <<
+                err->message << "\n";
+        }
+        if (parser.depth_exceeded()) {
+            std::cout << "Input nests too deeply\n";
+        }
         std::cout << "Input does NOT match grammar\n";
         return 1;
     }
 }
 )xx";
 
+//
+// code.parser is false - there is only the lexer, so print the tokens.
+//
+const std::string gen_main_lex_code = R"xx(
+    (void)parser_debug;
+    (void)prelex;
+    if (window == 0) {
+        window = 4096;
+    }
+    bool done = false;
+    while (not done) {
+        if (not parallel) {
+            tokens.clear();
+            lexer->lex_into(tokens, window);
+        }
+        for (std::size_t i = 0; i < tokens.size(); ++i) {
+            std::cout << YalrParser::token_name(tokens.types[i]) << ' ' <<
+                tokens.offsets[i] << ' ' << tokens.lengths[i] << '\n';
+            done = done or tokens.types[i] == YalrParser::eoi;
+        }
+        done = done or parallel;
+    }
+    return 0;
+}
+)xx";
+
 } // namespace yalr::codegen
 
 #endif
@@ -1,7 +1,10 @@
 #include "analyzer.hpp"
+#include "regex_tree.hpp"
+#include "lexgen.hpp"
 
 #include "yassert.hpp"
 
+#include <map>
 #include <unordered_set>
 
 
@@ -15,6 +18,21 @@ std::unordered_set<std::string_view> verbatim_locations = {
 };
 
 namespace analyzer {
+//
+// The built in types that the lexer converts the lexeme to itself, and the
+// C++ type of each. @lexeme is handled separately.
+//
+const std::map<std::string_view, std::string_view> converted_types = {
+    { "@int64",  "std::int64_t" },
+    { "@uint64", "std::uint64_t" },
+    { "@double", "double" },
+    { "@atom",   "atom" },
+};
+
+bool is_builtin_type(std::string_view type_str) {
+    return type_str == "@lexeme" or converted_types.count(type_str) > 0;
+}
+
 //
 // Helper function to register a pattern as a new terminal
 //
@@ -80,6 +98,20 @@ void fix_up_pattern(T& x, optional_text_fragment case_text, analyzer_tree& out)
     }
 }
 
+//
+// Make sure the generated lexer will be able to compile the pattern, rather
+// than finding out when it starts up.
+//
+template<class T>
+void check_pattern(const T& x, const text_fragment& pattern_text, analyzer_tree& out) {
+    if (x.pat_type == pattern_type::regex) {
+        auto message = validate_regex(x.pattern, x.case_match);
+        if (not message.empty()) {
+            out.record_error(pattern_text, "invalid regex pattern: ", message);
+        }
+    }
+}
+
 //
 // Helper function to parse an associativity specifier
 //
@@ -173,11 +205,8 @@ struct phase_i_visitor {
             }
         }
 
-        if (r.type_str) {
-            if (r.type_str->text == "@lexeme") {
-                rs.type_str = "std::string";
-            }
-        }
+        // @lexeme is resolved once all the options are known.
+        // See resolve_lexeme_types().
     }
 
     //
@@ -192,13 +221,12 @@ struct phase_i_visitor {
         terminal_symbol ts{t};
 
         if (t.type_str) {
-            if (t.type_str->text == "@lexeme") {
+            if (is_builtin_type(t.type_str->text)) {
+                // The type and action are filled in by
+                // resolve_lexeme_types() once all the options are known.
                 if (t.action) {
-                    out.record_error(t.name, "terminal has type @lexeme but "
-                            "already has an action");
-                } else {
-                    ts.action = "return std::move(lexeme);";
-                    ts.type_str = "std::string";
+                    out.record_error(t.name, "terminal has type ",
+                            t.type_str->text, " but already has an action");
                 }
             } else if (t.type_str->text != "void" and not t.action) {
                 out.record_error(t.name, "'", t.name,
@@ -225,6 +253,7 @@ struct phase_i_visitor {
         ts.case_match = case_type::match;
 
         fix_up_pattern(ts, t.case_match, out);
+        check_pattern(ts, t.pattern, out);
 
 
         ts.is_inline = t.is_inline;
@@ -291,6 +320,7 @@ struct phase_i_visitor {
         }
         std::string_view full_pattern = ss.pattern;
         fix_up_pattern(ss, s.case_match, out);
+        check_pattern(ss, s.pattern, out);
         ss.token_name = ss.name;
 
 
@@ -556,6 +586,145 @@ struct phase_ii_visitor {
 
 };
 
+//
+// Fill in the type (and action) for terminals and rules declared
+// with the type @lexeme. This depends on lexer.lexeme which may be set
+// anywhere in the file, so it has to wait until after phase I.
+//
+// The numeric types (e.g. @int64) and @atom are converted by the lexer
+// straight from the input, so their terminals get no action.
+//
+void resolve_lexeme_types(analyzer_tree& out) {
+    bool view = (out.options.lexer_lexeme.get() == lexeme_type::view);
+
+    for (const auto& [_, sym] : out.symbols) {
+        if (auto *term = sym.get_data<symbol_type::terminal>()) {
+            if (term->type_str == "@lexeme") {
+                if (view) {
+                    term->type_str = "std::string_view";
+                    term->action = "return lexeme;";
+                } else {
+                    term->type_str = "std::string";
+                    term->action = "return std::move(lexeme);";
+                }
+            } else if (auto iter = converted_types.find(term->type_str);
+                    iter != converted_types.end()) {
+                term->builtin_type = term->type_str.substr(1);
+                term->type_str = iter->second;
+            }
+        } else if (auto *rule = sym.get_data<symbol_type::rule>()) {
+            if (rule->type_str == "@lexeme") {
+                rule->type_str = (view ? "std::string_view" : "std::string");
+            } else if (auto iter = converted_types.find(rule->type_str);
+                    iter != converted_types.end()) {
+                rule->type_str = iter->second;
+            }
+        }
+    }
+}
+
+//
+// The pattern of a term or skip as the lexer generator sees it.
+//
+std::optional<lexer_pattern> symbol_pattern(const symbol& sym) {
+    if (const auto *term = sym.get_data<symbol_type::terminal>()) {
+        return lexer_pattern{term->pattern, term->pat_type, term->case_match};
+    } else if (const auto *skip = sym.get_data<symbol_type::skip>()) {
+        return lexer_pattern{skip->pattern, skip->pat_type, skip->case_match, true};
+    }
+    return std::nullopt;
+}
+
+//
+// Every term and skip with the cost of matching it, in the order (and
+// so with the same lexer) that codegen will use.
+//
+std::vector<std::pair<symbol, pattern_cost>> lexer_pattern_costs(
+        const analyzer_tree& tree) {
+    std::vector<symbol> syms;
+    for (const auto &[_, sym] : tree.symbols) {
+        if (sym.name() != "$" and symbol_pattern(sym)) {
+            syms.push_back(sym);
+        }
+    }
+    std::sort(syms.begin(), syms.end());
+
+    std::vector<lexer_pattern> patterns;
+    for (const auto &sym : syms) {
+        patterns.push_back(*symbol_pattern(sym));
+    }
+    auto costs = analyze_pattern_costs(patterns,
+            tree.options.lexer_engine.get(),
+            tree.options.lexer_contextual.get());
+
+    std::vector<std::pair<symbol, pattern_cost>> retval;
+    for (std::size_t index = 0; index < syms.size(); ++index) {
+        retval.emplace_back(syms[index], std::move(costs[index]));
+    }
+
+    return retval;
+}
+
+//
+// Warn about regex patterns that will be left to std::regex and are
+// known to backtrack badly. With strict_linear, any pattern left to
+// std::regex is an error. Whether a pattern makes it into the DFA depends
+// on every other pattern, so this has to wait until after phase II has
+// registered the inline terminals.
+//
+void check_pattern_costs(const parse_tree& tree, analyzer_tree& out,
+        bool strict_linear) {
+    std::map<std::string_view, pattern_cost> costs;
+    for (auto& [sym, cost] : lexer_pattern_costs(out)) {
+        costs.emplace(sym.name(), std::move(cost));
+    }
+
+    // A keyword found through a std::regex identifier is reported with
+    // the identifier.
+    auto check = [&](const terminal_stmt& t) {
+        auto sym = out.symbols.find(t.name.text);
+        auto pattern = (sym ? symbol_pattern(*sym) : std::nullopt);
+        if (not pattern or pattern->pat_type != pattern_type::regex) {
+            return;
+        }
+        auto iter = costs.find(t.name.text);
+        if (iter == costs.end() or iter->second.linear()) {
+            return;
+        }
+        const auto& cost = iter->second;
+        if (strict_linear) {
+            auto &err = out.record_error(t.pattern,
+                    "pattern can't be guaranteed to match in linear time - ",
+                    cost.reason);
+            for (const auto& hazard : cost.hazards) {
+                err.add_info(hazard, t.pattern);
+            }
+            if (cost.deep_recursion) {
+                err.add_info(deep_recursion_hazard, t.pattern);
+            }
+        } else {
+            for (const auto& hazard : cost.hazards) {
+                out.record_warning(t.pattern, "std::regex may be slow on this "
+                        "pattern: ", hazard);
+            }
+            // Not worth repeating for every pattern when std::regex was
+            // asked for.
+            if (cost.deep_recursion and
+                    out.options.lexer_engine.get() != lexer_engine_type::regex) {
+                out.record_warning(t.pattern, deep_recursion_hazard);
+            }
+        }
+    };
+
+    for (const auto& stmt : tree.statements) {
+        if (const auto *t = std::get_if<terminal_stmt>(&stmt)) {
+            check(*t);
+        } else if (const auto *sk = std::get_if<skip_stmt>(&stmt)) {
+            check(*sk);
+        }
+    }
+}
+
 //
 //
 //
@@ -576,7 +745,8 @@ symbol register_pattern_terminal(yalr::analyzer_tree& out, text_fragment pattern
 
 }
 
-std::unique_ptr<yalr::analyzer_tree> analyze(const yalr::parse_tree &tree) {
+std::unique_ptr<yalr::analyzer_tree> analyze(const yalr::parse_tree &tree,
+        bool strict_linear) {
     auto retval = std::make_unique<yalr::analyzer_tree>();
 
 
@@ -589,14 +759,16 @@ std::unique_ptr<yalr::analyzer_tree> analyze(const yalr::parse_tree &tree) {
         std::visit(sv, d);
     }
 
+    resolve_lexeme_types(*retval);
 
-    // Make sure there is a goal defined
-    if (not sv.goal_rule) {
+    // Make sure there is a goal defined - unless only a lexer is wanted.
+    bool lexer_only = not retval->options.code_parser.get();
+    if (not sv.goal_rule and not lexer_only) {
         retval->record_error(text_fragment{"", text_location{0, tree.source}},
                 "No goal rule was declared.");
     }
 
-    if (retval->errors.size() > 0) {
+    if (retval->errors.error_count() > 0) {
         retval->success = false;
         return retval;
     }
@@ -610,6 +782,21 @@ std::unique_ptr<yalr::analyzer_tree> analyze(const yalr::parse_tree &tree) {
         std::visit(pv, d);
     }
 
+    check_pattern_costs(tree, *retval, strict_linear);
+
+
+    // add the pseudo terminal '$' to represent the
+    // end of input.
+    terminal_symbol eoi;
+    eoi.name = "$";
+    eoi.type_str = "void";
+
+    if (not sv.goal_rule) {
+        // Lexer only - there is nothing to augment.
+        retval->symbols.add(eoi.name, eoi);
+        retval->success = (retval->errors.error_count() == 0);
+        return retval;
+    }
 
     /* As a last step, augment the grammar with a "Rule 0" that
      * is simply : Goal' => Goal
@@ -637,19 +824,35 @@ std::unique_ptr<yalr::analyzer_tree> analyze(const yalr::parse_tree &tree) {
 
     retval->target_prod = retval->productions.back().prod_id;
 
-    // add the pseudo terminal '$' to represent the
-    // end of input.
-    terminal_symbol eoi;
-    eoi.name = "$";
-    eoi.type_str = "void";
     retval->symbols.add(eoi.name, eoi);
 
-    retval->success = (retval->errors.size() == 0);
+    retval->success = (retval->errors.error_count() == 0);
 
     return retval;
 }
 
 
+void pattern_report(const analyzer_tree &tree, std::ostream& strm) {
+    strm << "============= PATTERNS ======================\n\n";
+    for (const auto &[sym, cost] : lexer_pattern_costs(tree)) {
+        strm << "   ";
+        strm.width(20);
+        strm << std::left << sym.name() << std::right << " " <<
+            pattern_engine_name(cost.engine);
+        if (cost.linear()) {
+            strm << " (linear)\n";
+            continue;
+        }
+        strm << " - " << cost.reason << "\n";
+        for (const auto& hazard : cost.hazards) {
+            strm << "        hazard: " << hazard << "\n";
+        }
+        if (cost.deep_recursion) {
+            strm << "        hazard: " << deep_recursion_hazard << "\n";
+        }
+    }
+}
+
 void pretty_print(const analyzer_tree &tree, std::ostream& strm) {
 
     strm << "----- BEGIN SYMBOLS -----\n";
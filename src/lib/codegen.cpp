@@ -3,11 +3,15 @@
 #include "utils.hpp"
 #include "template_genmain.hpp"
 #include "analyzer_tree.hpp"
+#include "lexgen.hpp"
 
 #include "yassert.hpp"
 
 #include <iostream>
 #include <sstream>
+#include <algorithm>
+#include <cstdio>
+#include <map>
 
 namespace yalr {
 
@@ -155,6 +159,468 @@ json generate_verbatim(const lrtable& lt) {
     return retval;
 }
 
+/****************************************************************************/
+//
+// Smallest unsigned type that will hold values up to max_value.
+//
+std::string smallest_uint_type(int max_value) {
+    if (max_value <= 0xff) {
+        return "std::uint8_t";
+    } else if (max_value <= 0xffff) {
+        return "std::uint16_t";
+    }
+    return "std::uint32_t";
+}
+
+//
+// Format a table of numbers as rows for the template. Each row is a
+// string of comma terminated values.
+//
+json table_rows(const std::vector<int>& values, std::size_t per_row) {
+    auto rows = json::array();
+
+    for (std::size_t start = 0; start < values.size(); start += per_row) {
+        std::string row;
+        auto end = std::min(values.size(), start + per_row);
+        for (auto i = start; i < end; ++i) {
+            row += std::to_string(values[i]) + ",";
+            if (i+1 < end) row += ' ';
+        }
+        rows.push_back(row);
+    }
+
+    return rows;
+}
+
+/****************************************************************************/
+json generate_dfa_data(const lexer_dfa& dfa) {
+    auto retval = json::object();
+
+    retval["use_dfa"] = not dfa.empty();
+    if (dfa.empty()) {
+        return retval;
+    }
+
+    retval["state_count"] = dfa.state_count;
+    retval["class_count"] = dfa.class_count;
+    retval["state_type"]  = smallest_uint_type(dfa.state_count - 1);
+
+    retval["byte_class"] = table_rows(std::vector<int>(dfa.byte_class.begin(),
+                dfa.byte_class.end()), 16);
+
+    // one row per state
+    retval["transitions"] = table_rows(dfa.transitions, dfa.class_count);
+
+    // the template wants 0 to mean "not accepting"
+    std::vector<int> accept;
+    int max_accept = 0;
+    for (auto a : dfa.accept) {
+        accept.push_back(a + 1);
+        max_accept = std::max(max_accept, a + 1);
+    }
+    retval["accept_type"] = smallest_uint_type(max_accept);
+    retval["accept"] = table_rows(accept, 16);
+
+    retval["accept_lists"] = not dfa.accept_start.empty();
+    if (not dfa.accept_start.empty()) {
+        retval["accept_start_type"] = smallest_uint_type(int(dfa.accept_list.size()));
+        retval["accept_start"] = table_rows(dfa.accept_start, 16);
+        retval["accept_list_type"] = smallest_uint_type(max_accept);
+        // there may be no accepting states at all
+        retval["accept_list"] = table_rows(dfa.accept_list.empty() ?
+                std::vector<int>{0} : dfa.accept_list, 16);
+    }
+
+    return retval;
+}
+
+/****************************************************************************/
+json generate_nfa_data(const lexer_nfa& nfa) {
+    auto retval = json::object();
+
+    retval["use_lazy"] = not nfa.empty();
+    if (nfa.empty()) {
+        return retval;
+    }
+
+    retval["state_count"] = nfa.state_count();
+    retval["class_count"] = nfa.class_count;
+    retval["set_count"]   = nfa.set_count();
+    retval["state_type"]  = smallest_uint_type(nfa.state_count());
+
+    retval["byte_class"] = table_rows(std::vector<int>(nfa.byte_class.begin(),
+                nfa.byte_class.end()), 16);
+
+    // the template wants 0 to mean "none" for sets and accept
+    std::vector<int> set;
+    for (auto x : nfa.set) {
+        set.push_back(x + 1);
+    }
+    retval["set_type"] = smallest_uint_type(nfa.set_count());
+    retval["set"] = table_rows(set, 16);
+
+    std::vector<int> next;
+    for (auto x : nfa.next) {
+        next.push_back(std::max(x, 0));
+    }
+    retval["next"] = table_rows(next, 16);
+
+    std::vector<int> accept;
+    int max_accept = 0;
+    for (auto a : nfa.accept) {
+        accept.push_back(a + 1);
+        max_accept = std::max(max_accept, a + 1);
+    }
+    retval["accept_type"] = smallest_uint_type(max_accept);
+    retval["accept"] = table_rows(accept, 16);
+
+    retval["eps_start_type"] = smallest_uint_type(int(nfa.eps.size()));
+    retval["eps_start"] = table_rows(nfa.eps_start, 16);
+    // there may be no epsilon moves at all
+    retval["eps"] = table_rows(nfa.eps.empty() ? std::vector<int>{0} : nfa.eps, 16);
+
+    // one row per set
+    retval["set_classes"] = table_rows(std::vector<int>(nfa.set_classes.begin(),
+                nfa.set_classes.end()), nfa.class_count);
+
+    return retval;
+}
+
+/****************************************************************************/
+//
+// For each byte, the list of matchers (by position in the `patterns` array)
+// whose pattern can start with that byte. Stored as a 257 entry offset table
+// into one flat list.
+//
+json generate_dispatch_data(const std::vector<char_set>& firsts) {
+    auto retval = json::object();
+
+    std::vector<int> start;
+    std::vector<int> list;
+    for (int c = 0; c < 256; ++c) {
+        start.push_back(int(list.size()));
+        for (std::size_t i = 0; i < firsts.size(); ++i) {
+            if (firsts[i][c]) {
+                list.push_back(int(i));
+            }
+        }
+    }
+    start.push_back(int(list.size()));
+
+    retval["use"] = not list.empty();
+    retval["start_type"] = smallest_uint_type(int(list.size()));
+    retval["list_type"] = smallest_uint_type(int(firsts.size()));
+    retval["start"] = table_rows(start, 16);
+    retval["list"] = table_rows(list, 16);
+
+    return retval;
+}
+
+/****************************************************************************/
+//
+// For lexer.contextual - the patterns that can come next in each state.
+// A pattern can come next if the state has an action for its token.
+// Skips can always come next. Each row is one pattern_set, 64 patterns to
+// a word.
+//
+json generate_state_patterns(const lrtable& lt,
+        const std::map<int, int>& pattern_of,
+        const std::vector<lexer_pattern>& patterns) {
+    auto retval = json::object();
+
+    const auto words = std::max<std::size_t>(1, (patterns.size() + 63) / 64);
+    retval["words"] = words;
+
+    auto rows = json::array();
+    for (const auto& state : lt.states) {
+        std::vector<std::uint64_t> bits(words, 0);
+        auto add = [&bits](int index) {
+            bits[std::size_t(index) / 64] |= std::uint64_t(1) << (index % 64);
+        };
+        for (std::size_t index = 0; index < patterns.size(); ++index) {
+            if (patterns[index].is_skip) {
+                add(int(index));
+            }
+        }
+        for (const auto& [sym, _] : state.actions) {
+            auto iter = pattern_of.find(int(sym.id()));
+            if (iter != pattern_of.end()) {
+                add(iter->second);
+            }
+        }
+
+        std::ostringstream row;
+        row << "{{";
+        for (std::size_t w = 0; w < words; ++w) {
+            row << (w > 0 ? ", " : "") << "0x" << std::hex << bits[w] << "ull";
+        }
+        row << "}}, // state " << std::dec << state.id;
+        rows.push_back(row.str());
+    }
+    retval["rows"] = rows;
+
+    return retval;
+}
+
+/****************************************************************************/
+//
+// Smallest signed type that will hold values from -max_value to max_value.
+//
+std::string smallest_int_type(int max_value) {
+    if (max_value <= 0x7f) {
+        return "std::int8_t";
+    } else if (max_value <= 0x7fff) {
+        return "std::int16_t";
+    }
+    return "std::int32_t";
+}
+
+//
+// ACTION and GOTO tables for parser.style table.
+//
+// Terms and rules each get a column, found through `columns`, which is
+// indexed by token value.
+//
+// An action is 0 for error, state + 1 for a shift, -(production + 1) for a
+// reduce and -(production count + 1) for accept. A goto is the new state.
+// States with identical rows share one.
+//
+json generate_parse_tables(const lrtable& lt) {
+    auto retval = json::object();
+
+    int max_token = 0;
+    int term_count = 0;
+    int rule_count = 0;
+    std::map<symbol, int> column;
+    for (const auto &[_, sym] : lt.symbols) {
+        if (sym.isterm()) {
+            column.emplace(sym, term_count++);
+        } else if (sym.isrule()) {
+            column.emplace(sym, rule_count++);
+        } else {
+            continue;
+        }
+        max_token = std::max(max_token, int(sym.id()));
+    }
+
+    std::vector<int> columns(std::size_t(max_token) + 1, -1);
+    for (const auto& [sym, col] : column) {
+        columns[std::size_t(int(sym.id()))] = col;
+    }
+
+    int prod_count = 0;
+    for (const auto& [id, _] : lt.productions) {
+        prod_count = std::max(prod_count, int(id) + 1);
+    }
+    const int accept_action = -(prod_count + 1);
+
+    std::vector<int> action_rows;
+    std::vector<int> action_row_of;
+    std::map<std::vector<int>, int> action_row_index;
+    std::vector<int> goto_rows;
+    std::vector<int> goto_row_of;
+    std::map<std::vector<int>, int> goto_row_index;
+
+    auto add_row = [](std::vector<int>& rows, std::map<std::vector<int>, int>& index,
+            const std::vector<int>& row) {
+        auto [iter, added] = index.try_emplace(row, int(index.size()));
+        if (added) {
+            rows.insert(rows.end(), row.begin(), row.end());
+        }
+        return iter->second;
+    };
+
+    for (const auto& state : lt.states) {
+        std::vector<int> row(std::size_t(term_count), 0);
+        for (const auto& [sym, action] : state.actions) {
+            auto& entry = row[std::size_t(column.at(sym))];
+            switch (action.type) {
+                case action_type::shift :
+                    entry = int(action.new_state_id) + 1;
+                    break;
+                case action_type::reduce :
+                    entry = -(int(action.production_id) + 1);
+                    break;
+                case action_type::accept :
+                    entry = accept_action;
+                    break;
+                default :
+                    yfail("action_type out of range");
+                    break;
+            }
+        }
+        action_row_of.push_back(add_row(action_rows, action_row_index, row));
+
+        std::vector<int> gotos(std::size_t(rule_count), 0);
+        for (const auto& [sym, new_state] : state.gotos) {
+            gotos[std::size_t(column.at(sym))] = int(new_state);
+        }
+        goto_row_of.push_back(add_row(goto_rows, goto_row_index, gotos));
+    }
+
+    std::vector<int> prod_symbol(std::size_t(prod_count), 0);
+    std::vector<int> prod_length(std::size_t(prod_count), 0);
+    for (const auto& [id, prod] : lt.productions) {
+        prod_symbol[std::size_t(int(id))] = int(prod.rule.id());
+        prod_length[std::size_t(int(id))] = int(prod.items.size());
+    }
+
+    const int state_count = int(lt.states.size());
+    const int max_column = std::max(term_count, rule_count);
+
+    retval["term_count"]    = term_count;
+    retval["rule_count"]    = rule_count;
+    retval["accept"]        = accept_action;
+    retval["action_type"]   = smallest_int_type(std::max(state_count, prod_count + 1));
+    retval["state_type"]    = smallest_uint_type(state_count - 1);
+    retval["column_type"]   = smallest_int_type(max_column);
+    retval["columns"]       = table_rows(columns, 16);
+    retval["actions"]       = table_rows(action_rows, std::size_t(term_count));
+    retval["action_row"]    = table_rows(action_row_of, 16);
+    retval["gotos"]         = table_rows(goto_rows, std::size_t(std::max(rule_count, 1)));
+    retval["goto_row"]      = table_rows(goto_row_of, 16);
+    retval["prod_symbol"]   = table_rows(prod_symbol, 16);
+    retval["prod_length"]   = table_rows(prod_length, 16);
+    retval["row_type"]      = smallest_uint_type(int(std::max(action_row_index.size(),
+                    goto_row_index.size())) - 1);
+
+    return retval;
+}
+
+/****************************************************************************/
+//
+// Perfect hash tables for the keywords that are found by looking up the
+// lexeme of an identifier rather than being matched themselves.
+//
+json generate_keyword_data(const std::vector<lexer_pattern>& patterns,
+        const std::vector<int>& promoted_to, const json& pattern_tokens) {
+
+    std::map<int, std::vector<int>> by_pattern;
+    for (std::size_t index = 0; index < promoted_to.size(); ++index) {
+        if (promoted_to[index] >= 0) {
+            by_pattern[promoted_to[index]].push_back(int(index));
+        }
+    }
+
+    auto retval = json::array();
+    for (const auto& [pattern, keywords] : by_pattern) {
+        auto table = build_keyword_table(patterns, pattern, keywords);
+
+        auto entries = json::array();
+        for (auto k : table.slots) {
+            auto edata = json::object();
+            if (k < 0) {
+                edata["text"] = "std::string_view()";
+                edata["token"] = "undef";
+                edata["fold"] = "false";
+            } else {
+                edata["text"] = "std::string_view(R\"%_^xx(" +
+                    std::string(patterns[k].pattern) + ")%_^xx\")";
+                edata["token"] = pattern_tokens[k];
+                edata["fold"] = (patterns[k].case_match == case_type::fold ?
+                        "true" : "false");
+            }
+            entries.push_back(edata);
+        }
+
+        retval.push_back(json::object({
+                    { "pattern", pattern },
+                    { "seed", table.seed },
+                    { "entries", entries }
+                    }));
+    }
+
+    return retval;
+}
+
+/****************************************************************************/
+//
+// A C++ expression for a std::string_view of exactly these bytes.
+// Each byte is written as an octal escape so that nothing in the
+// pattern can end the literal early.
+//
+std::string cpp_bytes(std::string_view bytes) {
+    std::string retval = "std::string_view(\"";
+    for (auto c : bytes) {
+        char buf[8];
+        std::snprintf(buf, sizeof(buf), "\\%03o", static_cast<unsigned char>(c));
+        retval += buf;
+    }
+    retval += "\", " + std::to_string(bytes.size()) + ")";
+
+    return retval;
+}
+
+//
+// Constructor for a byte_set in the generated lexer. Whichever of the
+// set and its complement is smaller is written out.
+//
+std::string byte_set_ctor(const char_set& cs) {
+    bool members = (cs.count() <= 128);
+    std::string bytes;
+    for (int c = 0; c < 256; ++c) {
+        if (cs[c] == members) {
+            bytes += char(c);
+        }
+    }
+
+    return "byte_set{" + cpp_bytes(bytes) + ", " +
+        (members ? "true" : "false") + "}";
+}
+
+//
+// Matcher entry for a skip or term that is handled by a scanner.
+//
+void generate_scanner_data(const skip_scanner& scanner, json& tdata) {
+    switch (scanner.type) {
+        case scanner_type::run :
+            tdata["matcher"] = "run_scanner";
+            tdata["pattern"] = byte_set_ctor(scanner.body);
+            tdata["reason"] = "scanner - run";
+            break;
+        case scanner_type::line :
+            tdata["matcher"] = "line_scanner";
+            tdata["pattern"] = cpp_bytes(scanner.prefix) + ", " +
+                byte_set_ctor(scanner.body) + ", " +
+                cpp_bytes(scanner.terminator);
+            tdata["reason"] = "scanner - line";
+            break;
+        case scanner_type::block : {
+                // The block scanner jumps to the next byte that is
+                // either not in the body or could start the terminator.
+                auto first = static_cast<unsigned char>(scanner.terminator[0]);
+                char_set stop = ~scanner.body;
+                stop.set(first);
+                tdata["matcher"] = "block_scanner";
+                tdata["pattern"] = cpp_bytes(scanner.prefix) + ", " +
+                    byte_set_ctor(stop) + ", " +
+                    cpp_bytes(scanner.terminator) + ", " +
+                    (scanner.body[first] ? "true" : "false");
+                tdata["reason"] = "scanner - block";
+            }
+            break;
+        case scanner_type::quoted : {
+                // Stops at anything not in the body, which includes the
+                // terminator and the escape.
+                auto term = static_cast<unsigned char>(scanner.terminator[0]);
+                char_set stop = ~scanner.body;
+                stop.set(term);
+                tdata["matcher"] = "quoted_scanner";
+                tdata["pattern"] = cpp_bytes(scanner.prefix) + ", " +
+                    byte_set_ctor(stop) + ", " +
+                    std::to_string(int(static_cast<unsigned char>(scanner.escape))) + ", " +
+                    byte_set_ctor(scanner.escaped) + ", " +
+                    std::to_string(int(term));
+                tdata["reason"] = "scanner - quoted";
+            }
+            break;
+        default :
+            yfail("scanner_type out of range");
+            break;
+    }
+    tdata["flags"] = " ";
+}
+
 /****************************************************************************/
 void generate_code(const lrtable& lt, std::ostream& outstrm) {
 
@@ -166,6 +632,12 @@ void generate_code(const lrtable& lt, std::ostream& outstrm) {
     data["parserclass"] = std::string(lt.options.parser_class.get());
     data["lexerclass"] = std::string(lt.options.lexer_class.get());
 
+    bool lexeme_view = (lt.options.lexer_lexeme.get() == lexeme_type::view);
+    data["lexeme_view"] = lexeme_view;
+    data["lexeme_param"] = (lexeme_view ? "std::string_view" : "std::string&&");
+    data["code_parser"] = lt.options.code_parser.get();
+    data["lexer_parallel"] = lt.options.lexer_parallel.get();
+
 
     // dump the tokens
     // We need two separate lists of tokens.
@@ -185,6 +657,8 @@ void generate_code(const lrtable& lt, std::ostream& outstrm) {
 
     // set of type names
     std::set<std::string>type_names;
+    // any terms of type @atom
+    bool has_atoms = false;
 
     for (const auto &[_, sym] : lt.symbols) {
         std::string tok_name = "TOK_" + std::string(sym.token_name());
@@ -203,19 +677,30 @@ void generate_code(const lrtable& lt, std::ostream& outstrm) {
                 if (info_ptr->type_str != "void") {
                     type_names.insert(std::string(info_ptr->type_str));
                 }
-                if (not info_ptr->action.empty()) {
+                if (not info_ptr->action.empty() or
+                        not info_ptr->builtin_type.empty()) {
                     semantic_actions.push_back(json::object({
                                 { "token", tok_name }, 
                                 { "block" , info_ptr->action },
-                                { "type"  , info_ptr->type_str }
+                                { "type"  , info_ptr->type_str },
+                                { "builtin", info_ptr->builtin_type }
                                 }));
                 }
+                if (info_ptr->builtin_type == "atom") {
+                    has_atoms = true;
+                }
 
             }
         } else if (sym.isrule()) {
-            // rules only go in the enum
+            // rules only go in the enum, but their values are on the
+            // parse stack along with the terms'
             enum_entries.push_back(json::object({ 
                     { "name" , tok_name }, {"value", int(sym.id()) } }));
+            const auto* info_ptr = sym.get_data<symbol_type::rule>();
+            yassert(info_ptr, "could not get data pointer for rule");
+            if (info_ptr->type_str != "void") {
+                type_names.insert(std::string(info_ptr->type_str));
+            }
         } else if (sym.isskip()) {
             // Skips only go in the term list
             terms.push_back(sym);
@@ -225,6 +710,7 @@ void generate_code(const lrtable& lt, std::ostream& outstrm) {
     }
 
     data["semantic_actions"] = semantic_actions;
+    data["has_atoms"] = has_atoms;
 
     enum_entries.push_back(json::object({ 
             { "name" , "undef"}, {"value", -1 } }));
@@ -247,30 +733,80 @@ void generate_code(const lrtable& lt, std::ostream& outstrm) {
     // spec.
     std::sort(terms.begin(), terms.end());
 
-    auto patterns = json::array();
+    // The patterns in definition order. This is also their priority
+    // in the lexer.
+    std::vector<lexer_pattern> lex_patterns;
+    auto pattern_tokens = json::array();
+    // symbol id -> index in lex_patterns
+    std::map<int, int> pattern_of;
 
     for (const auto& sym : terms) {
-        auto tdata = json::object();
-
-        std::string pattern;
-        case_type ct;
-        pattern_type pt;
         const auto* info_ptr = sym.get_data<symbol_type::terminal>();
 
         if (info_ptr == nullptr) {
             const auto *skip_ptr = sym.get_data<symbol_type::skip>();
-            pattern = std::string(skip_ptr->pattern);
-            pt = skip_ptr->pat_type;
-            ct = skip_ptr->case_match;
+            lex_patterns.push_back({skip_ptr->pattern, skip_ptr->pat_type,
+                    skip_ptr->case_match, true});
+            pattern_tokens.push_back("skip");
         } else {
-            pattern =  std::string(info_ptr->pattern);
-            pt = info_ptr->pat_type;
-            ct = info_ptr->case_match;
+            pattern_of[int(sym.id())] = int(lex_patterns.size());
+            lex_patterns.push_back({info_ptr->pattern, info_ptr->pat_type,
+                    info_ptr->case_match});
+            pattern_tokens.push_back("TOK_" + std::string(info_ptr->token_name));
         }
+    }
+
+    data["pattern_tokens"] = pattern_tokens;
+
+    auto engine = lt.options.lexer_engine.get();
+    auto contextual = lt.options.lexer_contextual.get();
+    data["lexer_contextual"] = contextual;
+
+    lexer_tables tables;
+    if (engine == lexer_engine_type::dfa or engine == lexer_engine_type::lazy) {
+        tables = generate_lexer_tables(lex_patterns,
+                lexer_options_for(engine, contextual));
+    } else {
+        tables.fallback.assign(lex_patterns.size(), "lexer.engine is regex");
+        tables.scanners.resize(lex_patterns.size());
+        if (contextual) {
+            tables.promoted_to.assign(lex_patterns.size(), -1);
+        } else {
+            tables.promoted_to = find_keyword_promotions(lex_patterns);
+        }
+    }
+
+    data["keywords"] = generate_keyword_data(lex_patterns, tables.promoted_to,
+            pattern_tokens);
+
+    data["lexer"] = generate_dfa_data(tables.dfa);
+    data["lexer"]["nfa"] = generate_nfa_data(tables.nfa);
+
+    // Anything that didn't make it into the DFA is handled
+    // by a matcher object - either a skip scanner or std::regex.
+    auto patterns = json::array();
+    std::vector<char_set> firsts;
+
+    for (std::size_t index = 0; index < lex_patterns.size(); ++index) {
+        const auto& scanner = tables.scanners[index];
+        if (tables.fallback[index].empty() and not scanner) {
+            continue;
+        }
+        if (tables.promoted_to[index] >= 0) {
+            continue;
+        }
+
+        const auto& lp = lex_patterns[index];
+        auto tdata = json::object();
+        auto pattern = std::string(lp.pattern);
 
         tdata["flags"] = " ";
-        if (pt == pattern_type::string) {
-            if (ct == case_type::fold) {
+        tdata["storage"] = "constexpr";
+        tdata["reason"] = tables.fallback[index];
+        if (scanner) {
+            generate_scanner_data(*scanner, tdata);
+        } else if (lp.pat_type == pattern_type::string) {
+            if (lp.case_match == case_type::fold) {
                 tdata["matcher"] = "fold_string_matcher";
             } else {
                 tdata["matcher"] = "string_matcher";
@@ -278,32 +814,54 @@ void generate_code(const lrtable& lt, std::ostream& outstrm) {
             tdata["pattern"] = "R\"%_^xx(" + pattern + ")%_^xx\"" ;
         } else {
             tdata["matcher"] = "regex_matcher";
+            // std::regex isn't a literal type
+            tdata["storage"] = "const";
             tdata["pattern"] = "R\"%_^xx(" + pattern  + ")%_^xx\"" ;
-            if (ct == case_type::fold) {
-                tdata["flags"] = ", std::regex::icase";
+            if (lp.case_match == case_type::fold) {
+                tdata["flags"] = ", std::regex::ECMAScript | std::regex::icase";
             }
         }
 
-        if (sym.isterm()) {
-            tdata["token"] = "TOK_" + std::string(info_ptr->token_name);
-        } else {
-            tdata["token"] = "skip" ;
-        }
+        tdata["token"] = pattern_tokens[index];
+        tdata["index"] = int(index);
 
         patterns.push_back(tdata);
-
+        firsts.push_back(pattern_first_chars(lp));
     }
 
+    data["dispatch"] = generate_dispatch_data(firsts);
+
     data["patterns"] = patterns;
 
 
     // define the Parser class
 
+    auto style = lt.options.parser_style.get();
+    auto table_style = (style == parser_style_type::table);
+    switch (style) {
+        case parser_style_type::table :
+            data["parser_style"] = "table";
+            break;
+        case parser_style_type::trampoline :
+            data["parser_style"] = "trampoline";
+            break;
+        default :
+            data["parser_style"] = "recursive";
+            break;
+    }
+
     auto states_array = json::array();
-    for (const auto& state : lt.states) {
-        states_array.push_back(generate_state_data(state, lt));
+    if (table_style) {
+        data["parse_tables"] = generate_parse_tables(lt);
+    } else {
+        for (const auto& state : lt.states) {
+            states_array.push_back(generate_state_data(state, lt));
+        }
     }
     data["states"] = states_array;
+    if (contextual) {
+        data["state_patterns"] = generate_state_patterns(lt, pattern_of, lex_patterns);
+    }
 
     data["reducefuncs"] = generate_reduce_functions(lt);
 
@@ -319,6 +877,11 @@ void generate_code(const lrtable& lt, std::ostream& outstrm) {
 
     if (lt.options.code_main.get() == true) {
         outstrm << yalr::codegen::gen_main_code;
+        if (lt.options.code_parser.get()) {
+            outstrm << yalr::codegen::gen_main_parse_code;
+        } else {
+            outstrm << yalr::codegen::gen_main_lex_code;
+        }
     }
 
 }
@@ -6,6 +6,16 @@ namespace yalr {
         "info", "warning", "error"
     };
 
+    int error_list::error_count() const {
+        int retval = 0;
+        for (auto const & e : errors) {
+            if (e.msg_type == message_type::error) {
+                retval += 1;
+            }
+        }
+        return retval;
+    }
+
     std::ostream& error_list::output(std::ostream& strm) const {
         for (auto const & e : errors) {
             e.output(strm);
@@ -0,0 +1,1294 @@
+#include "lexgen.hpp"
+#include "regex_tree.hpp"
+
+#include "yassert.hpp"
+
+#include <map>
+#include <set>
+#include <cctype>
+#include <algorithm>
+
+/*
+ * Build the lexer DFA.
+ *
+ * Each pattern is parsed into a regex_node tree, the trees are turned into
+ * a single NFA (Thompson's construction), and the NFA into a DFA with the
+ * subset construction. The DFA is then minimized with Moore's partition
+ * refinement.
+ *
+ * To keep the tables small, the alphabet is not the 256 byte values but the
+ * equivalence classes of bytes that no pattern can tell apart.
+ *
+ * When a DFA state contains the accepting NFA states of more than one
+ * pattern, the pattern that was defined first wins.
+ *
+ * For lexer.engine lazy, the subset construction is left to the generated
+ * lexer, which only builds the DFA states the input actually reaches.
+ *
+ * Compilers: Principles, Techniques, and Tools
+ * Aho, Sethi, Ullman
+ * Copyright 1986
+ * Section 3.7 - 3.9
+ */
+namespace yalr {
+
+namespace {
+
+// Limits to keep a pathological pattern from eating all of memory.
+// Patterns that go past these are left to std::regex.
+constexpr int max_nfa_states = 20000;
+constexpr int max_dfa_states = 20000;
+
+struct nfa_state {
+    std::vector<int> eps;
+    // byte transition - index into nfa::sets, -1 if none.
+    int set_id = -1;
+    int next = -1;
+    // index of the pattern accepted here, -1 if none.
+    int accept = -1;
+};
+
+struct nfa_fragment {
+    int start;
+    int end;
+};
+
+struct nfa {
+    std::vector<nfa_state> states;
+    std::vector<char_set> sets;
+    std::map<std::string, int> set_ids;
+    std::string error;
+
+    int new_state() {
+        states.emplace_back();
+        return int(states.size()) - 1;
+    }
+
+    int add_set(const char_set& cs) {
+        auto [iter, inserted] = set_ids.try_emplace(cs.to_string(), int(sets.size()));
+        if (inserted) {
+            sets.push_back(cs);
+        }
+        return iter->second;
+    }
+
+    bool too_big() const { return int(states.size()) > max_nfa_states; }
+
+    //
+    // Thompson's construction.
+    // Returns false (and sets `error`) if the tree uses something
+    // that has no automaton equivalent.
+    //
+    bool build(const regex_node& node, nfa_fragment& frag) {
+        if (too_big()) {
+            error = "pattern is too large";
+            return false;
+        }
+
+        switch (node.type) {
+            case regex_node_type::empty :
+                frag.start = frag.end = new_state();
+                return true;
+
+            case regex_node_type::chars :
+                frag.start = new_state();
+                frag.end = new_state();
+                states[frag.start].set_id = add_set(node.chars);
+                states[frag.start].next = frag.end;
+                return true;
+
+            case regex_node_type::concat : {
+                    bool first = true;
+                    for (const auto& child : node.children) {
+                        nfa_fragment cf;
+                        if (not build(child, cf)) return false;
+                        if (first) {
+                            frag = cf;
+                            first = false;
+                        } else {
+                            states[frag.end].eps.push_back(cf.start);
+                            frag.end = cf.end;
+                        }
+                    }
+                    if (first) {
+                        frag.start = frag.end = new_state();
+                    }
+                    return true;
+                }
+
+            case regex_node_type::alternate : {
+                    frag.start = new_state();
+                    frag.end = new_state();
+                    for (const auto& child : node.children) {
+                        nfa_fragment cf;
+                        if (not build(child, cf)) return false;
+                        states[frag.start].eps.push_back(cf.start);
+                        states[cf.end].eps.push_back(frag.end);
+                    }
+                    return true;
+                }
+
+            case regex_node_type::repeat :
+                return build_repeat(node, frag);
+
+            case regex_node_type::assertion :
+                error = "anchors and word boundaries are not supported";
+                return false;
+
+            case regex_node_type::backref :
+                error = "backreferences are not supported";
+                return false;
+
+            case regex_node_type::lookahead :
+                error = "lookahead is not supported";
+                return false;
+
+            default :
+                yfail("regex_node_type out of range");
+        }
+    }
+
+    bool build_repeat(const regex_node& node, nfa_fragment& frag) {
+        if (node.lazy) {
+            error = "non-greedy quantifiers are not supported";
+            return false;
+        }
+
+        const auto& sub = node.children.front();
+
+        frag.start = frag.end = new_state();
+        auto append = [this, &frag](nfa_fragment cf) {
+            states[frag.end].eps.push_back(cf.start);
+            frag.end = cf.end;
+        };
+
+        for (int i = 0; i < node.min; ++i) {
+            nfa_fragment cf;
+            if (not build(sub, cf)) return false;
+            append(cf);
+        }
+
+        if (node.max == -1) {
+            // Kleene star
+            nfa_fragment cf;
+            if (not build(sub, cf)) return false;
+            auto s = new_state();
+            auto e = new_state();
+            states[s].eps.push_back(cf.start);
+            states[s].eps.push_back(e);
+            states[cf.end].eps.push_back(cf.start);
+            states[cf.end].eps.push_back(e);
+            append({s, e});
+        } else {
+            for (int i = node.min; i < node.max; ++i) {
+                nfa_fragment cf;
+                if (not build(sub, cf)) return false;
+                auto s = new_state();
+                auto e = new_state();
+                states[s].eps.push_back(cf.start);
+                states[s].eps.push_back(e);
+                states[cf.end].eps.push_back(e);
+                append({s, e});
+            }
+        }
+
+        return true;
+    }
+};
+
+using state_set = std::vector<int>;
+
+//
+// Add everything reachable by epsilon moves. Returns the set sorted so that
+// it can be used as a key.
+//
+state_set closure(const nfa& n, state_set s) {
+    std::vector<bool> seen(n.states.size(), false);
+    std::vector<int> stack;
+
+    for (auto i : s) {
+        seen[i] = true;
+        stack.push_back(i);
+    }
+
+    while (not stack.empty()) {
+        auto i = stack.back();
+        stack.pop_back();
+        for (auto j : n.states[i].eps) {
+            if (not seen[j]) {
+                seen[j] = true;
+                s.push_back(j);
+                stack.push_back(j);
+            }
+        }
+    }
+
+    std::sort(s.begin(), s.end());
+    return s;
+}
+
+//
+// Split the bytes into classes such that every byte in a class is in
+// exactly the same subset of the NFA's character sets.
+//
+int compute_byte_classes(const nfa& n, std::array<int, 256>& byte_class,
+        std::vector<int>& representative) {
+    std::map<std::vector<bool>, int> class_ids;
+
+    for (int c = 0; c < 256; ++c) {
+        std::vector<bool> key;
+        key.reserve(n.sets.size());
+        for (const auto& cs : n.sets) {
+            key.push_back(cs[c]);
+        }
+        auto [iter, inserted] = class_ids.try_emplace(key, int(class_ids.size()));
+        if (inserted) {
+            representative.push_back(c);
+        }
+        byte_class[c] = iter->second;
+    }
+
+    return int(class_ids.size());
+}
+
+//
+// Subset construction. State 0 is the dead (empty) state.
+//
+bool build_dfa(const nfa& n, int start, lexer_dfa& dfa,
+        std::vector<std::vector<int>>& accept_lists) {
+    std::vector<int> representative;
+    dfa.class_count = compute_byte_classes(n, dfa.byte_class, representative);
+
+    std::map<state_set, int> ids;
+    std::vector<state_set> work;
+
+    auto lookup = [&](state_set&& s) {
+        auto [iter, inserted] = ids.try_emplace(s, int(work.size()));
+        if (inserted) {
+            work.push_back(std::move(s));
+        }
+        return iter->second;
+    };
+
+    lookup(state_set{});
+    lookup(closure(n, {start}));
+
+    for (std::size_t current = 0; current < work.size(); ++current) {
+        if (int(work.size()) > max_dfa_states) {
+            return false;
+        }
+
+        std::vector<int> accepts;
+        for (auto s : work[current]) {
+            if (n.states[s].accept >= 0) {
+                accepts.push_back(n.states[s].accept);
+            }
+        }
+        std::sort(accepts.begin(), accepts.end());
+        accepts.erase(std::unique(accepts.begin(), accepts.end()), accepts.end());
+        dfa.accept.push_back(accepts.empty() ? -1 : accepts.front());
+        accept_lists.push_back(std::move(accepts));
+
+        for (int cls = 0; cls < dfa.class_count; ++cls) {
+            auto c = representative[cls];
+            state_set next;
+            for (auto s : work[current]) {
+                const auto& ns = n.states[s];
+                if (ns.set_id >= 0 and n.sets[ns.set_id][c]) {
+                    next.push_back(ns.next);
+                }
+            }
+            // careful - `work` may reallocate in lookup()
+            auto id = lookup(next.empty() ? state_set{} : closure(n, std::move(next)));
+            dfa.transitions.push_back(id);
+        }
+    }
+
+    dfa.state_count = int(work.size());
+    return true;
+}
+
+//
+// Moore's algorithm. Start with the states split by the pattern they accept
+// and keep splitting blocks whose members go to different blocks on the same
+// byte class.
+//
+// If accept_lists is not empty, states are split by the full list of
+// patterns they accept instead, and the lists are kept for the new states.
+//
+void minimize(lexer_dfa& dfa, std::vector<std::vector<int>>& accept_lists) {
+    const auto n = dfa.state_count;
+    const auto k = dfa.class_count;
+    const bool lists = not accept_lists.empty();
+
+    std::vector<int> block(n);
+    int block_count;
+    {
+        std::map<std::vector<int>, int> by_accept;
+        for (int s = 0; s < n; ++s) {
+            auto key = (lists ? accept_lists[s] : std::vector<int>{dfa.accept[s]});
+            auto [iter, _] = by_accept.try_emplace(std::move(key), int(by_accept.size()));
+            block[s] = iter->second;
+        }
+        block_count = int(by_accept.size());
+    }
+
+    while (true) {
+        std::map<std::vector<int>, int> sigs;
+        std::vector<int> new_block(n);
+        for (int s = 0; s < n; ++s) {
+            std::vector<int> sig;
+            sig.reserve(k + 1);
+            sig.push_back(block[s]);
+            for (int c = 0; c < k; ++c) {
+                sig.push_back(block[dfa.transitions[s * k + c]]);
+            }
+            auto [iter, _] = sigs.try_emplace(std::move(sig), int(sigs.size()));
+            new_block[s] = iter->second;
+        }
+        block = std::move(new_block);
+        if (int(sigs.size()) == block_count) break;
+        block_count = int(sigs.size());
+    }
+
+    //
+    // Renumber so that the dead state stays 0 and the start state stays 1.
+    //
+    std::vector<int> new_id(block_count, -1);
+    int next_id = 0;
+    for (int s = 0; s < n; ++s) {
+        if (new_id[block[s]] < 0) {
+            new_id[block[s]] = next_id++;
+        }
+    }
+
+    lexer_dfa retval;
+    retval.byte_class = dfa.byte_class;
+    retval.class_count = k;
+    retval.state_count = block_count;
+    retval.accept.assign(block_count, -1);
+    retval.transitions.assign(block_count * k, 0);
+
+    std::vector<std::vector<int>> new_lists(lists ? block_count : 0);
+    for (int s = 0; s < n; ++s) {
+        auto ns = new_id[block[s]];
+        retval.accept[ns] = dfa.accept[s];
+        if (lists) {
+            new_lists[ns] = accept_lists[s];
+        }
+        for (int c = 0; c < k; ++c) {
+            retval.transitions[ns * k + c] = new_id[block[dfa.transitions[s * k + c]]];
+        }
+    }
+
+    dfa = std::move(retval);
+    accept_lists = std::move(new_lists);
+}
+
+//
+// After minimization some byte classes may behave identically.
+// Merge them.
+//
+void merge_byte_classes(lexer_dfa& dfa) {
+    const auto k = dfa.class_count;
+    std::map<std::vector<int>, int> columns;
+    std::vector<int> new_class(k);
+    std::vector<int> keep;
+
+    for (int c = 0; c < k; ++c) {
+        std::vector<int> column;
+        column.reserve(dfa.state_count);
+        for (int s = 0; s < dfa.state_count; ++s) {
+            column.push_back(dfa.transitions[s * k + c]);
+        }
+        auto [iter, inserted] = columns.try_emplace(std::move(column), int(columns.size()));
+        if (inserted) {
+            keep.push_back(c);
+        }
+        new_class[c] = iter->second;
+    }
+
+    if (int(keep.size()) == k) return;
+
+    std::vector<int> transitions;
+    transitions.reserve(dfa.state_count * keep.size());
+    for (int s = 0; s < dfa.state_count; ++s) {
+        for (auto c : keep) {
+            transitions.push_back(dfa.transitions[s * k + c]);
+        }
+    }
+
+    for (auto& bc : dfa.byte_class) {
+        bc = new_class[bc];
+    }
+    dfa.class_count = int(keep.size());
+    dfa.transitions = std::move(transitions);
+}
+
+//
+// Flatten the NFA into the tables the generated lexer needs to run it.
+//
+void export_nfa(const nfa& n, lexer_nfa& out) {
+    std::vector<int> representative;
+    out.class_count = compute_byte_classes(n, out.byte_class, representative);
+
+    for (const auto& cs : n.sets) {
+        for (auto c : representative) {
+            out.set_classes.push_back(cs[c]);
+        }
+    }
+
+    for (const auto& ns : n.states) {
+        out.set.push_back(ns.set_id);
+        out.next.push_back(ns.next);
+        out.accept.push_back(ns.accept);
+        out.eps_start.push_back(int(out.eps.size()));
+        out.eps.insert(out.eps.end(), ns.eps.begin(), ns.eps.end());
+    }
+    out.eps_start.push_back(int(out.eps.size()));
+}
+
+} // anonymous namespace
+
+/****************************************************************************/
+std::pair<int, std::size_t> lexer_dfa::longest_match(std::string_view input) const {
+    std::pair<int, std::size_t> retval{-1, 0};
+
+    if (empty()) return retval;
+
+    int state = 1;
+    for (std::size_t i = 0; i < input.size(); ++i) {
+        state = next_state(state, static_cast<unsigned char>(input[i]));
+        if (state == 0) break;
+        if (accept[state] >= 0) {
+            retval = {accept[state], i+1};
+        }
+    }
+
+    return retval;
+}
+
+/****************************************************************************/
+std::pair<int, std::size_t> lexer_nfa::longest_match(std::string_view input) const {
+    std::pair<int, std::size_t> retval{-1, 0};
+
+    if (empty()) return retval;
+
+    std::vector<bool> seen;
+    auto add_closure = [&](std::vector<int>& set, int start) {
+        std::vector<int> stack{start};
+        while (not stack.empty()) {
+            auto s = stack.back();
+            stack.pop_back();
+            if (seen[s]) continue;
+            seen[s] = true;
+            set.push_back(s);
+            for (auto i = eps_start[s]; i < eps_start[s+1]; ++i) {
+                stack.push_back(eps[i]);
+            }
+        }
+    };
+
+    std::vector<int> current;
+    seen.assign(set.size(), false);
+    add_closure(current, 0);
+
+    for (std::size_t i = 0; i < input.size() and not current.empty(); ++i) {
+        auto cls = byte_class[static_cast<unsigned char>(input[i])];
+        std::vector<int> following;
+        seen.assign(set.size(), false);
+        int acc = -1;
+        for (auto s : current) {
+            if (set[s] >= 0 and set_classes[set[s] * class_count + cls]) {
+                add_closure(following, next[s]);
+            }
+        }
+        for (auto s : following) {
+            if (accept[s] >= 0 and (acc < 0 or accept[s] < acc)) {
+                acc = accept[s];
+            }
+        }
+        if (acc >= 0) {
+            retval = {acc, i+1};
+        }
+        current = std::move(following);
+    }
+
+    return retval;
+}
+
+/****************************************************************************/
+namespace {
+
+lexer_tables build_lexer_tables(const std::vector<lexer_pattern>& patterns,
+        std::vector<int> promoted_to, const lexer_build_options& options) {
+    lexer_tables retval;
+    retval.fallback.resize(patterns.size());
+    retval.scanners.resize(patterns.size());
+    retval.promoted_to = std::move(promoted_to);
+
+    nfa n;
+    auto start = n.new_state();
+    bool any = false;
+    // start state of each pattern's fragment -> pattern index
+    std::map<int, int> fragments;
+
+    for (std::size_t index = 0; index < patterns.size(); ++index) {
+        const auto& pat = patterns[index];
+
+        if (retval.promoted_to[index] >= 0) {
+            continue;
+        }
+
+        // Terms are only taken out of the DFA for the delimited shapes.
+        // Those are the ones that can be long or need std::regex.
+        if (options.scanners) {
+            auto scanner = find_skip_scanner(pat);
+            if (scanner and (pat.is_skip or scanner->type != scanner_type::run)) {
+                retval.scanners[index] = std::move(scanner);
+                continue;
+            }
+        }
+
+        regex_node tree;
+        if (pat.pat_type == pattern_type::string) {
+            tree = literal_regex(pat.pattern, pat.case_match);
+        } else {
+            auto result = parse_regex(pat.pattern, pat.case_match);
+            if (not result) {
+                retval.fallback[index] = result.message;
+                continue;
+            }
+            tree = std::move(result.tree);
+        }
+
+        //
+        // Build the fragment off to the side so that a failure
+        // doesn't leave half a pattern hooked to the start state.
+        //
+        auto mark = n.states.size();
+        nfa_fragment frag;
+        if (not n.build(tree, frag)) {
+            retval.fallback[index] = n.error;
+            n.states.resize(mark);
+            continue;
+        }
+
+        n.states[frag.end].accept = int(index);
+        n.states[start].eps.push_back(frag.start);
+        fragments[frag.start] = int(index);
+        any = true;
+    }
+
+    if (not any) {
+        return retval;
+    }
+
+    if (options.lazy) {
+        export_nfa(n, retval.nfa);
+        return retval;
+    }
+
+    lexer_dfa dfa;
+    std::vector<std::vector<int>> accept_lists;
+    std::map<int, int> own_size;
+    while (not build_dfa(n, start, dfa, accept_lists)) {
+        //
+        // Leave the pattern with the largest DFA of its own to std::regex
+        // and try again without it. The fragment stays in the NFA, but
+        // can no longer be reached.
+        //
+        auto& eps = n.states[start].eps;
+        if (own_size.empty()) {
+            auto all = eps;
+            for (auto s : all) {
+                lexer_dfa single;
+                std::vector<std::vector<int>> lists;
+                eps = {s};
+                own_size[s] = (build_dfa(n, start, single, lists) ?
+                        single.state_count : max_dfa_states + 1);
+            }
+            eps = std::move(all);
+        }
+        auto largest = std::max_element(eps.begin(), eps.end(),
+                [&](int a, int b) {
+                    return std::pair{own_size[a], fragments[a]} <
+                        std::pair{own_size[b], fragments[b]};
+                });
+        retval.fallback[std::size_t(fragments[*largest])] =
+            "combined lexer DFA is too large";
+        eps.erase(largest);
+        if (eps.empty()) {
+            return retval;
+        }
+        dfa = lexer_dfa{};
+        accept_lists.clear();
+    }
+
+    if (not options.accept_lists) {
+        accept_lists.clear();
+    }
+    minimize(dfa, accept_lists);
+
+    // Everything matched only the empty string - which never wins.
+    if (dfa.state_count < 2) {
+        return retval;
+    }
+
+    merge_byte_classes(dfa);
+
+    if (options.accept_lists) {
+        for (const auto& list : accept_lists) {
+            dfa.accept_start.push_back(int(dfa.accept_list.size()));
+            dfa.accept_list.insert(dfa.accept_list.end(), list.begin(), list.end());
+        }
+        dfa.accept_start.push_back(int(dfa.accept_list.size()));
+    }
+
+    retval.dfa = std::move(dfa);
+
+    return retval;
+}
+
+} // anonymous namespace
+
+/****************************************************************************/
+lexer_tables generate_lexer_tables(const std::vector<lexer_pattern>& patterns,
+        const lexer_build_options& options) {
+    if (options.promote_keywords) {
+        return build_lexer_tables(patterns, find_keyword_promotions(patterns), options);
+    }
+    return build_lexer_tables(patterns, std::vector<int>(patterns.size(), -1), options);
+}
+
+/****************************************************************************/
+lexer_build_options lexer_options_for(lexer_engine_type engine, bool contextual) {
+    lexer_build_options retval;
+    // A promoted keyword is only found through its identifier, which
+    // may not be wanted when the keyword is.
+    retval.promote_keywords = not contextual;
+    retval.lazy = (engine == lexer_engine_type::lazy);
+    retval.accept_lists = contextual;
+
+    return retval;
+}
+
+/****************************************************************************/
+namespace {
+
+//
+// If the node matches exactly one byte, the set of bytes it can match.
+//
+std::optional<char_set> single_byte_set(const regex_node& node) {
+    if (node.type == regex_node_type::chars) {
+        return node.chars;
+    }
+
+    if (node.type == regex_node_type::alternate) {
+        char_set retval;
+        for (const auto& child : node.children) {
+            auto cs = single_byte_set(child);
+            if (not cs) return std::nullopt;
+            retval |= *cs;
+        }
+        return retval;
+    }
+
+    return std::nullopt;
+}
+
+void flatten_concat(const regex_node& node, std::vector<const regex_node*>& items) {
+    if (node.type == regex_node_type::concat) {
+        for (const auto& child : node.children) {
+            flatten_concat(child, items);
+        }
+    } else {
+        items.push_back(&node);
+    }
+}
+
+//
+// Append the byte if the node matches exactly one specific byte.
+//
+bool append_fixed_byte(const regex_node& node, std::string& str) {
+    if (node.type == regex_node_type::chars and node.chars.count() == 1) {
+        for (int c = 0; c < 256; ++c) {
+            if (node.chars[c]) {
+                str += char(c);
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+//
+// For (?:[body]|escape[escaped]) - in either order, with body possibly
+// split over several alternatives - fills in the escape and returns the
+// body. The escape can't be in the body, or which alternative is taken
+// would matter.
+//
+std::optional<char_set> escaped_body(const regex_node& node, skip_scanner& scanner) {
+    if (node.type != regex_node_type::alternate) {
+        return std::nullopt;
+    }
+
+    char_set body;
+    bool have_escape = false;
+    for (const auto& child : node.children) {
+        if (auto cs = single_byte_set(child)) {
+            body |= *cs;
+            continue;
+        }
+
+        std::vector<const regex_node*> items;
+        flatten_concat(child, items);
+        std::string escape;
+        if (have_escape or items.size() != 2 or
+                not append_fixed_byte(*items[0], escape)) {
+            return std::nullopt;
+        }
+        auto escaped = single_byte_set(*items[1]);
+        if (not escaped or escaped->none()) {
+            return std::nullopt;
+        }
+        scanner.escape = escape[0];
+        scanner.escaped = *escaped;
+        have_escape = true;
+    }
+
+    if (not have_escape or body[static_cast<unsigned char>(scanner.escape)]) {
+        return std::nullopt;
+    }
+
+    return body;
+}
+
+} // namespace
+
+std::optional<skip_scanner> find_skip_scanner(const lexer_pattern& pattern) {
+    if (pattern.pat_type != pattern_type::regex) {
+        return std::nullopt;
+    }
+
+    auto result = parse_regex(pattern.pattern, pattern.case_match);
+    if (not result) {
+        return std::nullopt;
+    }
+
+    std::vector<const regex_node*> items;
+    flatten_concat(result.tree, items);
+
+    skip_scanner retval;
+
+    auto iter = items.begin();
+    while (iter != items.end() and append_fixed_byte(**iter, retval.prefix)) {
+        ++iter;
+    }
+
+    if (iter == items.end() or (*iter)->type != regex_node_type::repeat or
+            (*iter)->max != -1) {
+        return std::nullopt;
+    }
+
+    const auto& rep = **iter;
+    auto body = single_byte_set(rep.children.front());
+    bool escapes = false;
+    if (not body) {
+        body = escaped_body(rep.children.front(), retval);
+        escapes = true;
+    }
+    if (not body or body->none()) {
+        return std::nullopt;
+    }
+    retval.body = *body;
+    ++iter;
+
+    while (iter != items.end() and append_fixed_byte(**iter, retval.terminator)) {
+        ++iter;
+    }
+
+    if (iter != items.end()) {
+        return std::nullopt;
+    }
+
+    if (escapes) {
+        if (rep.min != 0 or retval.prefix.empty() or
+                retval.terminator.size() != 1) {
+            return std::nullopt;
+        }
+        auto term = static_cast<unsigned char>(retval.terminator[0]);
+        if (term == static_cast<unsigned char>(retval.escape)) {
+            return std::nullopt;
+        }
+        //
+        // The greedy body could go on past the terminator if the
+        // terminator can be part of the body. The non-greedy one stops at
+        // the first.
+        //
+        if (not rep.lazy and retval.body[term]) {
+            return std::nullopt;
+        }
+        retval.type = scanner_type::quoted;
+        return retval;
+    }
+
+    if (rep.lazy) {
+        if (rep.min == 0 and not retval.prefix.empty() and
+                not retval.terminator.empty()) {
+            retval.type = scanner_type::block;
+            return retval;
+        }
+    } else if (rep.min == 1 and retval.prefix.empty() and
+            retval.terminator.empty()) {
+        retval.type = scanner_type::run;
+        return retval;
+    } else if (rep.min == 0 and not retval.prefix.empty() and
+            retval.terminator.size() <= 1) {
+        //
+        // The greedy body can't give anything back to the terminator
+        // if the terminator can't be part of the body.
+        //
+        if (retval.terminator.empty() or
+                not retval.body[static_cast<unsigned char>(retval.terminator[0])]) {
+            retval.type = scanner_type::line;
+            return retval;
+        }
+    }
+
+    return std::nullopt;
+}
+
+/****************************************************************************/
+char_set pattern_first_chars(const lexer_pattern& pattern) {
+    if (pattern.pat_type == pattern_type::string) {
+        return first_chars(literal_regex(pattern.pattern, pattern.case_match));
+    }
+
+    auto result = parse_regex(pattern.pattern, pattern.case_match);
+    if (not result) {
+        char_set retval;
+        return retval.set();
+    }
+
+    return first_chars(result.tree);
+}
+
+/****************************************************************************/
+namespace {
+
+//
+// What a pattern matches, for find_keyword_promotions(). dfa is empty if
+// the pattern can't be analyzed (or can only match the empty string).
+// The DFA is built even for patterns the lexer matches with a scanner. A
+// keyword is never promoted to one of those, but one that would match the
+// keyword stops it from being promoted past.
+//
+struct pattern_matches {
+    lexer_dfa dfa;
+    bool known = false;
+    bool scanner = false;
+};
+
+pattern_matches analyze_pattern(const lexer_pattern& pattern) {
+    pattern_matches retval;
+    lexer_build_options options;
+    options.scanners = false;
+    auto tables = build_lexer_tables({pattern}, {-1}, options);
+    retval.known = tables.fallback[0].empty();
+    retval.dfa = std::move(tables.dfa);
+    auto scanner = find_skip_scanner(pattern);
+    retval.scanner = (scanner and
+            (pattern.is_skip or scanner->type != scanner_type::run));
+    return retval;
+}
+
+//
+// Run the DFA over every string a literal can match at once.
+// Returns {matches all of them, matches at least one of them}.
+//
+std::pair<bool, bool> match_literal(const lexer_dfa& dfa,
+        const std::vector<char_set>& literal) {
+    if (dfa.empty()) {
+        return {false, false};
+    }
+
+    bool all = true;
+    std::vector<int> states{1};
+    for (const auto& cs : literal) {
+        std::vector<int> next;
+        for (auto state : states) {
+            for (int c = 0; c < 256; ++c) {
+                if (not cs[c]) continue;
+                auto ns = dfa.next_state(state, static_cast<unsigned char>(c));
+                if (ns == 0) {
+                    all = false;
+                } else if (std::find(next.begin(), next.end(), ns) == next.end()) {
+                    next.push_back(ns);
+                }
+            }
+        }
+        states = std::move(next);
+        if (states.empty()) {
+            return {false, false};
+        }
+    }
+
+    bool any = false;
+    for (auto state : states) {
+        if (dfa.accept[state] >= 0) {
+            any = true;
+        } else {
+            all = false;
+        }
+    }
+
+    return {all, any};
+}
+
+} // anonymous namespace
+
+/****************************************************************************/
+std::vector<int> find_keyword_promotions(const std::vector<lexer_pattern>& patterns) {
+    std::vector<int> retval(patterns.size(), -1);
+
+    std::vector<pattern_matches> matches;
+    for (const auto& pat : patterns) {
+        matches.push_back(analyze_pattern(pat));
+    }
+
+    for (std::size_t k = 0; k < patterns.size(); ++k) {
+        const auto& keyword = patterns[k];
+        if (keyword.is_skip or keyword.pat_type != pattern_type::string or
+                keyword.pattern.empty()) {
+            continue;
+        }
+
+        auto tree = literal_regex(keyword.pattern, keyword.case_match);
+        std::vector<const regex_node*> items;
+        flatten_concat(tree, items);
+        std::vector<char_set> literal;
+        for (const auto* item : items) {
+            literal.push_back(item->chars);
+        }
+
+        for (auto j = k + 1; j < patterns.size(); ++j) {
+            if (not matches[j].known) {
+                break;
+            }
+            auto [all, any] = match_literal(matches[j].dfa, literal);
+            if (all and not patterns[j].is_skip and not matches[j].scanner and
+                    patterns[j].pat_type == pattern_type::regex) {
+                retval[k] = int(j);
+                break;
+            }
+            if (any) {
+                break;
+            }
+        }
+    }
+
+    //
+    // The lookup hashes with case folded, so keywords that differ only in
+    // case can't share a table. Only the first of them is promoted - the
+    // others stay in the DFA, ahead of the identifier.
+    //
+    std::set<std::pair<int, std::string>> seen;
+    for (std::size_t k = 0; k < patterns.size(); ++k) {
+        if (retval[k] < 0) {
+            continue;
+        }
+        std::string folded;
+        for (auto c : patterns[k].pattern) {
+            folded.push_back(char(std::tolower(static_cast<unsigned char>(c))));
+        }
+        if (not seen.emplace(retval[k], std::move(folded)).second) {
+            retval[k] = -1;
+        }
+    }
+
+    // If no table can be built for an identifier, it gets no keywords.
+    std::map<int, std::vector<int>> by_pattern;
+    for (std::size_t k = 0; k < patterns.size(); ++k) {
+        if (retval[k] >= 0) {
+            by_pattern[retval[k]].push_back(int(k));
+        }
+    }
+    for (const auto& [pattern, keywords] : by_pattern) {
+        if (build_keyword_table(patterns, pattern, keywords).slots.empty()) {
+            for (auto k : keywords) {
+                retval[std::size_t(k)] = -1;
+            }
+        }
+    }
+
+    return retval;
+}
+
+/****************************************************************************/
+std::uint32_t keyword_hash(std::string_view text, std::uint32_t seed) {
+    std::uint32_t h = 2166136261u ^ seed;
+    for (auto c : text) {
+        auto b = static_cast<unsigned char>(c);
+        if (b >= 'A' and b <= 'Z') {
+            b = static_cast<unsigned char>(b - 'A' + 'a');
+        }
+        h ^= b;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+/****************************************************************************/
+keyword_table build_keyword_table(const std::vector<lexer_pattern>& patterns,
+        int pattern, const std::vector<int>& keywords) {
+
+    keyword_table retval;
+    retval.pattern = pattern;
+
+    std::size_t size = 1;
+    while (size < keywords.size() * 2) {
+        size *= 2;
+    }
+
+    //
+    // Try seeds until none of the keywords collide. With the table at
+    // most half full, this doesn't take many. Keywords whose text hashes
+    // the same whatever the seed never stop colliding, so give up after
+    // a few doublings.
+    //
+    auto max_size = size * 16;
+    for (; size <= max_size; size *= 2) {
+        for (std::uint32_t seed = 0; seed < 1000; ++seed) {
+            std::vector<int> slots(size, -1);
+            bool ok = true;
+            for (auto k : keywords) {
+                auto slot = keyword_hash(patterns[k].pattern, seed) & (size - 1);
+                if (slots[slot] >= 0) {
+                    ok = false;
+                    break;
+                }
+                slots[slot] = k;
+            }
+            if (ok) {
+                retval.seed = seed;
+                retval.slots = std::move(slots);
+                return retval;
+            }
+        }
+    }
+
+    return retval;
+}
+
+/****************************************************************************/
+namespace {
+
+bool has_unbounded_repeat(const regex_node& node) {
+    if (node.type == regex_node_type::repeat and node.max == -1) {
+        return true;
+    }
+    return std::any_of(node.children.begin(), node.children.end(),
+            has_unbounded_repeat);
+}
+
+//
+// The bytes a repeat can consume on each time around.
+//
+char_set repeat_bytes(const regex_node& node) {
+    char_set retval;
+    if (node.type == regex_node_type::chars) {
+        retval = node.chars;
+    }
+    for (const auto& child : node.children) {
+        retval |= repeat_bytes(child);
+    }
+    return retval;
+}
+
+void add_hazard(pattern_cost& cost, const std::string& hazard) {
+    if (std::find(cost.hazards.begin(), cost.hazards.end(), hazard) ==
+            cost.hazards.end()) {
+        cost.hazards.push_back(hazard);
+    }
+}
+
+//
+// Look for the classic causes of catastrophic backtracking.
+//
+void find_hazards(const regex_node& node, pattern_cost& cost) {
+    switch (node.type) {
+        case regex_node_type::backref :
+            add_hazard(cost, "backreference - matching can take exponential time");
+            break;
+
+        case regex_node_type::repeat : {
+                if (node.max == -1) {
+                    cost.deep_recursion = true;
+                }
+                if (node.max == -1 or node.max > 1) {
+                    const auto& child = node.children.front();
+                    if (has_unbounded_repeat(child)) {
+                        add_hazard(cost, "nested repeats (e.g. (a+)+) - "
+                                "backtracking can take exponential time");
+                    }
+                    if (child.type == regex_node_type::alternate) {
+                        char_set seen;
+                        for (const auto& alt : child.children) {
+                            auto first = first_chars(alt);
+                            if ((seen & first).any()) {
+                                add_hazard(cost, "repeated alternatives that can start "
+                                        "the same way (e.g. (a|ab)*) - backtracking "
+                                        "can take exponential time");
+                                break;
+                            }
+                            seen |= first;
+                        }
+                    }
+                }
+            }
+            break;
+
+        case regex_node_type::concat :
+            for (std::size_t i = 0; i + 1 < node.children.size(); ++i) {
+                const auto& a = node.children[i];
+                const auto& b = node.children[i+1];
+                if (a.type == regex_node_type::repeat and a.max == -1 and
+                        b.type == regex_node_type::repeat and b.max == -1 and
+                        (repeat_bytes(a) & repeat_bytes(b)).any()) {
+                    add_hazard(cost, "adjacent repeats over the same characters "
+                            "(e.g. \\d*\\d*) - backtracking can take polynomial time");
+                }
+            }
+            break;
+
+        default :
+            break;
+    }
+
+    for (const auto& child : node.children) {
+        find_hazards(child, cost);
+    }
+}
+
+void add_regex_hazards(const lexer_pattern& pattern, pattern_cost& cost) {
+    auto result = parse_regex(pattern.pattern, pattern.case_match);
+    if (not result) {
+        // Nothing more can be said about it.
+        cost.deep_recursion = true;
+        return;
+    }
+
+    find_hazards(result.tree, cost);
+}
+
+} // anonymous namespace
+
+/****************************************************************************/
+pattern_cost analyze_pattern_cost(const lexer_pattern& pattern,
+        lexer_engine_type engine) {
+    pattern_cost retval;
+
+    if (pattern.pat_type == pattern_type::string) {
+        switch (engine) {
+            case lexer_engine_type::regex :
+                retval.engine = pattern_engine::string;
+                break;
+            case lexer_engine_type::lazy :
+                retval.engine = pattern_engine::lazy_dfa;
+                break;
+            default :
+                retval.engine = pattern_engine::dfa;
+                break;
+        }
+        return retval;
+    }
+
+    if (engine != lexer_engine_type::regex) {
+        auto scanner = find_skip_scanner(pattern);
+        if (scanner and (pattern.is_skip or scanner->type != scanner_type::run)) {
+            retval.engine = pattern_engine::scanner;
+            return retval;
+        }
+
+        auto single = pattern;
+        single.is_skip = false;
+        lexer_build_options options;
+        options.lazy = (engine == lexer_engine_type::lazy);
+        auto tables = build_lexer_tables({single}, {-1}, options);
+        if (tables.fallback[0].empty()) {
+            retval.engine = (options.lazy ? pattern_engine::lazy_dfa : pattern_engine::dfa);
+            return retval;
+        }
+        retval.reason = tables.fallback[0];
+    } else {
+        retval.reason = "lexer.engine is regex";
+    }
+
+    add_regex_hazards(pattern, retval);
+
+    return retval;
+}
+
+/****************************************************************************/
+std::vector<pattern_cost> analyze_pattern_costs(
+        const std::vector<lexer_pattern>& patterns,
+        lexer_engine_type engine, bool contextual) {
+    std::vector<pattern_cost> retval;
+    for (const auto& pattern : patterns) {
+        retval.push_back(analyze_pattern_cost(pattern, engine));
+    }
+
+    if (engine == lexer_engine_type::regex) {
+        return retval;
+    }
+
+    auto tables = generate_lexer_tables(patterns,
+            lexer_options_for(engine, contextual));
+
+    //
+    // A pattern left out of the DFA is matched with a string compare if it
+    // is a string, otherwise with std::regex.
+    //
+    for (std::size_t index = 0; index < patterns.size(); ++index) {
+        if (tables.fallback[index].empty() or tables.scanners[index] or
+                tables.promoted_to[index] >= 0) {
+            continue;
+        }
+        auto& cost = retval[index];
+        cost = pattern_cost{};
+        if (patterns[index].pat_type == pattern_type::string) {
+            cost.engine = pattern_engine::string;
+        } else {
+            cost.reason = tables.fallback[index];
+            add_regex_hazards(patterns[index], cost);
+        }
+    }
+
+    // A promoted keyword is found by whatever matches its identifier.
+    for (std::size_t index = 0; index < patterns.size(); ++index) {
+        auto target = tables.promoted_to[index];
+        if (target >= 0) {
+            retval[index] = retval[std::size_t(target)];
+        }
+    }
+
+    return retval;
+}
+
+const char * const deep_recursion_hazard = "std::regex may recurse once per "
+    "repetition and run out of stack on long input";
+
+/****************************************************************************/
+const char *pattern_engine_name(pattern_engine e) {
+    switch (e) {
+        case pattern_engine::dfa      : return "dfa";
+        case pattern_engine::lazy_dfa : return "lazy dfa";
+        case pattern_engine::scanner  : return "scanner";
+        case pattern_engine::string   : return "string";
+        case pattern_engine::regex    : return "std::regex";
+    }
+    return "?";
+}
+
+} // namespace yalr
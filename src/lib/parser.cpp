@@ -907,7 +907,8 @@ struct parser_guts {
             }
             dot_count += 1;
             last_match_dot = true;
-            otf = match_identifier();
+            // keywords are fine after the dot too - e.g. code.parser
+            otf = match_identifier(true);
         }
 
         if (dot_count == 0) {
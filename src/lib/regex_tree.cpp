@@ -0,0 +1,712 @@
+#include "regex_tree.hpp"
+
+#include "yassert.hpp"
+
+#include <cctype>
+#include <optional>
+#include <regex>
+
+/*
+ * A recursive descent parser for the ECMAScript regular expression grammar
+ * as implemented by std::regex.
+ *
+ * The point is not to replace std::regex but to understand the patterns well
+ * enough to turn them into automata at generation time. So, when in doubt,
+ * the parser gives up (regex_status::unsupported) and lets the caller fall
+ * back to handing the pattern to std::regex at runtime.
+ */
+namespace yalr {
+
+using namespace std::literals::string_literals;
+
+namespace {
+
+//
+// Add the other case of every ASCII letter in the set.
+//
+char_set fold_case(char_set cs) {
+    for (int c = 'a'; c <= 'z'; ++c) {
+        int uc = c - 'a' + 'A';
+        if (cs[c] or cs[uc]) {
+            cs.set(c);
+            cs.set(uc);
+        }
+    }
+    return cs;
+}
+
+char_set single_char(unsigned char c) {
+    char_set retval;
+    retval.set(c);
+    return retval;
+}
+
+char_set char_range(int lo, int hi) {
+    char_set retval;
+    for (int c = lo; c <= hi; ++c) {
+        retval.set(c);
+    }
+    return retval;
+}
+
+template <class Pred>
+char_set ctype_set(Pred p) {
+    char_set retval;
+    for (int c = 0; c < 128; ++c) {
+        if (p(c)) retval.set(c);
+    }
+    return retval;
+}
+
+char_set digit_set() { return char_range('0', '9'); }
+
+char_set word_set() {
+    auto retval = ctype_set([](int c) { return std::isalnum(c) != 0; });
+    retval.set('_');
+    return retval;
+}
+
+char_set space_set() {
+    return ctype_set([](int c) { return std::isspace(c) != 0; });
+}
+
+//
+// The named classes allowed inside brackets - [[:alpha:]]
+//
+std::optional<char_set> posix_class(std::string_view name) {
+    if (name == "alnum") return ctype_set([](int c) { return std::isalnum(c) != 0; });
+    if (name == "alpha") return ctype_set([](int c) { return std::isalpha(c) != 0; });
+    if (name == "blank") return ctype_set([](int c) { return std::isblank(c) != 0; });
+    if (name == "cntrl") return ctype_set([](int c) { return std::iscntrl(c) != 0; });
+    if (name == "digit" or name == "d") return digit_set();
+    if (name == "graph") return ctype_set([](int c) { return std::isgraph(c) != 0; });
+    if (name == "lower") return ctype_set([](int c) { return std::islower(c) != 0; });
+    if (name == "print") return ctype_set([](int c) { return std::isprint(c) != 0; });
+    if (name == "punct") return ctype_set([](int c) { return std::ispunct(c) != 0; });
+    if (name == "space" or name == "s") return space_set();
+    if (name == "upper") return ctype_set([](int c) { return std::isupper(c) != 0; });
+    if (name == "xdigit") return ctype_set([](int c) { return std::isxdigit(c) != 0; });
+    if (name == "w") return word_set();
+
+    return std::nullopt;
+}
+
+int hex_value(char c) {
+    if (c >= '0' and c <= '9') return c - '0';
+    if (c >= 'a' and c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' and c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+struct regex_parser_guts {
+    std::string_view pattern;
+    std::size_t pos = 0;
+    bool fold;
+
+    regex_status status = regex_status::ok;
+    std::string message;
+    int offset = 0;
+
+    regex_parser_guts(std::string_view p, case_type ct) :
+        pattern(p), fold(ct == case_type::fold) {}
+
+    /****************************************************************
+     * Error Handling
+     ****************************************************************/
+    // Only the first problem is kept.
+    void record_error(regex_status s, const std::string& msg) {
+        if (status == regex_status::ok) {
+            status = s;
+            message = msg;
+            offset = int(pos);
+        }
+    }
+
+    std::nullopt_t invalid(const std::string& msg) {
+        record_error(regex_status::invalid, msg);
+        return std::nullopt;
+    }
+
+    std::nullopt_t unsupported(const std::string& msg) {
+        record_error(regex_status::unsupported, msg);
+        return std::nullopt;
+    }
+
+    /****************************************************************
+     * Input Utilities
+     ****************************************************************/
+    bool eoi() const { return pos >= pattern.size(); }
+
+    char peek(std::size_t ahead = 0) const {
+        return (pos + ahead < pattern.size()) ? pattern[pos + ahead] : '\x00';
+    }
+
+    bool match_char(char c) {
+        if (not eoi() and pattern[pos] == c) {
+            ++pos;
+            return true;
+        }
+        return false;
+    }
+
+    regex_node make_chars(const char_set& cs) const {
+        return regex_node{fold ? fold_case(cs) : cs};
+    }
+
+    /****************************************************************
+     * PARSING ROUTINES
+     ****************************************************************/
+
+    //
+    // disjunction := alternative ( '|' alternative )*
+    //
+    std::optional<regex_node> parse_disjunction() {
+        regex_node retval{regex_node_type::alternate};
+
+        do {
+            auto alt = parse_alternative();
+            if (not alt) return std::nullopt;
+            retval.children.push_back(std::move(*alt));
+        } while (match_char('|'));
+
+        if (retval.children.size() == 1) {
+            return std::move(retval.children.front());
+        }
+        return retval;
+    }
+
+    //
+    // alternative := term*
+    //
+    std::optional<regex_node> parse_alternative() {
+        regex_node retval{regex_node_type::concat};
+
+        while (not eoi() and peek() != '|' and peek() != ')') {
+            auto term = parse_term();
+            if (not term) return std::nullopt;
+            retval.children.push_back(std::move(*term));
+        }
+
+        if (retval.children.empty()) {
+            return regex_node{regex_node_type::empty};
+        } else if (retval.children.size() == 1) {
+            return std::move(retval.children.front());
+        }
+        return retval;
+    }
+
+    //
+    // term := assertion | atom quantifier?
+    //
+    std::optional<regex_node> parse_term() {
+        auto c = peek();
+
+        if (c == '^' or c == '$') {
+            ++pos;
+            regex_node retval{regex_node_type::assertion};
+            retval.value = c;
+            return no_quantifier(std::move(retval));
+        }
+
+        if (c == '\\' and (peek(1) == 'b' or peek(1) == 'B')) {
+            pos += 2;
+            regex_node retval{regex_node_type::assertion};
+            retval.value = pattern[pos-1];
+            return no_quantifier(std::move(retval));
+        }
+
+        if (c == '(' and peek(1) == '?' and (peek(2) == '=' or peek(2) == '!')) {
+            pos += 3;
+            regex_node retval{regex_node_type::lookahead};
+            retval.negated = (pattern[pos-1] == '!');
+            auto sub = parse_disjunction();
+            if (not sub) return std::nullopt;
+            if (not match_char(')')) return invalid("missing ')'");
+            retval.children.push_back(std::move(*sub));
+            return no_quantifier(std::move(retval));
+        }
+
+        auto atom = parse_atom();
+        if (not atom) return std::nullopt;
+
+        return parse_quantifier(std::move(*atom));
+    }
+
+    std::optional<regex_node> no_quantifier(regex_node&& node) {
+        auto c = peek();
+        if (c == '*' or c == '+' or c == '?' or c == '{') {
+            return invalid("nothing to repeat");
+        }
+        return std::move(node);
+    }
+
+    //
+    // quantifier := ( '*' | '+' | '?' | '{' n ( ',' m? )? '}' ) '?'?
+    //
+    std::optional<regex_node> parse_quantifier(regex_node&& atom) {
+        int min, max;
+
+        if (match_char('*')) {
+            min = 0; max = -1;
+        } else if (match_char('+')) {
+            min = 1; max = -1;
+        } else if (match_char('?')) {
+            min = 0; max = 1;
+        } else if (match_char('{')) {
+            auto lo = parse_number();
+            if (not lo) return invalid("bad repeat count");
+            min = max = *lo;
+            if (match_char(',')) {
+                if (peek() == '}') {
+                    max = -1;
+                } else {
+                    auto hi = parse_number();
+                    if (not hi) return invalid("bad repeat count");
+                    max = *hi;
+                }
+            }
+            if (not match_char('}')) return invalid("bad repeat count");
+            if (max != -1 and max < min) return invalid("bad repeat range");
+        } else {
+            return std::move(atom);
+        }
+
+        regex_node retval{regex_node_type::repeat};
+        retval.min = min;
+        retval.max = max;
+        retval.lazy = match_char('?');
+        retval.children.push_back(std::move(atom));
+
+        auto c = peek();
+        if (c == '*' or c == '+' or c == '?' or c == '{') {
+            return invalid("nothing to repeat");
+        }
+
+        return retval;
+    }
+
+    std::optional<int> parse_number() {
+        if (not std::isdigit(static_cast<unsigned char>(peek()))) return std::nullopt;
+
+        long value = 0;
+        while (std::isdigit(static_cast<unsigned char>(peek()))) {
+            value = value * 10 + (peek() - '0');
+            if (value > 100000) return std::nullopt;
+            ++pos;
+        }
+        return int(value);
+    }
+
+    //
+    // atom := '.' | '\' escape | class | '(' disjunction ')' |
+    //          '(?:' disjunction ')' | pattern_char
+    //
+    std::optional<regex_node> parse_atom() {
+        auto c = peek();
+
+        switch (c) {
+            case '.' : {
+                    ++pos;
+                    char_set cs;
+                    cs.set();
+                    cs.reset('\n');
+                    cs.reset('\r');
+                    return regex_node{cs};
+                }
+            case '\\' :
+                ++pos;
+                return parse_atom_escape();
+            case '[' :
+                ++pos;
+                return parse_class();
+            case '(' : {
+                    ++pos;
+                    if (peek() == '?') {
+                        if (peek(1) != ':') {
+                            return invalid("unknown group type");
+                        }
+                        pos += 2;
+                    }
+                    auto sub = parse_disjunction();
+                    if (not sub) return std::nullopt;
+                    if (not match_char(')')) return invalid("missing ')'");
+                    return sub;
+                }
+            case ')' :
+                return invalid("unmatched ')'");
+            case '*' : case '+' : case '?' : case '{' :
+                return invalid("nothing to repeat");
+            case ']' : case '}' :
+                return unsupported("unescaped '"s + c + "'");
+            default :
+                ++pos;
+                return make_chars(single_char(static_cast<unsigned char>(c)));
+        }
+    }
+
+    //
+    // Escapes outside of a bracket expression.
+    //
+    std::optional<regex_node> parse_atom_escape() {
+        if (eoi()) return invalid("trailing backslash");
+
+        auto c = peek();
+        if (c >= '1' and c <= '9') {
+            ++pos;
+            regex_node retval{regex_node_type::backref};
+            retval.value = c - '0';
+            return retval;
+        }
+
+        auto cs = parse_char_escape(false);
+        if (not cs) return std::nullopt;
+        return make_chars(*cs);
+    }
+
+    //
+    // Escapes that stand for a character or a character class. These are
+    // shared between the inside and the outside of a bracket expression.
+    // `pos` is just after the backslash.
+    //
+    std::optional<char_set> parse_char_escape(bool in_class) {
+        if (eoi()) return invalid("trailing backslash");
+
+        auto c = pattern[pos++];
+        switch (c) {
+            case 'd' : return digit_set();
+            case 'D' : return ~digit_set();
+            case 'w' : return word_set();
+            case 'W' : return ~word_set();
+            case 's' : return space_set();
+            case 'S' : return ~space_set();
+            case 'n' : return single_char('\n');
+            case 'r' : return single_char('\r');
+            case 't' : return single_char('\t');
+            case 'f' : return single_char('\f');
+            case 'v' : return single_char('\v');
+            case 'b' :
+                if (in_class) return single_char('\b');
+                break;
+            case '0' :
+                if (std::isdigit(static_cast<unsigned char>(peek()))) {
+                    return unsupported("octal escape");
+                }
+                return single_char('\0');
+            case 'c' : {
+                    auto l = peek();
+                    if (std::isalpha(static_cast<unsigned char>(l))) {
+                        ++pos;
+                        return single_char(static_cast<unsigned char>(l % 32));
+                    }
+                    return invalid("bad control escape");
+                }
+            case 'x' : {
+                    auto hi = hex_value(peek());
+                    auto lo = hex_value(peek(1));
+                    if (hi < 0 or lo < 0) return invalid("bad hex escape");
+                    pos += 2;
+                    return single_char(static_cast<unsigned char>(hi * 16 + lo));
+                }
+            case 'u' : {
+                    int value = 0;
+                    for (int i = 0; i < 4; ++i) {
+                        auto h = hex_value(peek());
+                        if (h < 0) return invalid("bad unicode escape");
+                        value = value * 16 + h;
+                        ++pos;
+                    }
+                    if (value > 255) return unsupported("unicode escape above \\xff");
+                    return single_char(static_cast<unsigned char>(value));
+                }
+            default :
+                break;
+        }
+
+        if (std::isalnum(static_cast<unsigned char>(c))) {
+            --pos;
+            return unsupported("unknown escape '\\"s + c + "'");
+        }
+
+        // identity escape
+        return single_char(static_cast<unsigned char>(c));
+    }
+
+    //
+    // class := '[' '^'? class_ranges ']'
+    // `pos` is just after the opening bracket.
+    //
+    std::optional<regex_node> parse_class() {
+        bool negate = match_char('^');
+        char_set cs;
+
+        if (peek() == ']') {
+            return unsupported("empty bracket expression");
+        }
+
+        while (not match_char(']')) {
+            if (eoi()) return invalid("missing ']'");
+
+            auto lo = parse_class_atom();
+            if (not lo) return std::nullopt;
+
+            if (peek() == '-' and peek(1) != ']' and peek(1) != '\x00') {
+                ++pos;
+                auto hi = parse_class_atom();
+                if (not hi) return std::nullopt;
+                if (lo->count() != 1 or hi->count() != 1) {
+                    return unsupported("range that uses a character class");
+                }
+                int lo_c = first_char(*lo);
+                int hi_c = first_char(*hi);
+                if (lo_c > hi_c) return invalid("bad range");
+                cs |= char_range(lo_c, hi_c);
+            } else {
+                cs |= *lo;
+            }
+        }
+
+        if (fold) cs = fold_case(cs);
+        if (negate) cs = ~cs;
+
+        return regex_node{cs};
+    }
+
+    static int first_char(const char_set& cs) {
+        for (int c = 0; c < 256; ++c) {
+            if (cs[c]) return c;
+        }
+        yfail("first_char called on an empty set");
+    }
+
+    std::optional<char_set> parse_class_atom() {
+        auto c = peek();
+        if (c == '\\') {
+            ++pos;
+            if (std::isdigit(static_cast<unsigned char>(peek())) and peek() != '0') {
+                return unsupported("backreference inside a bracket expression");
+            }
+            if (peek() == 'B') {
+                return unsupported("\\B inside a bracket expression");
+            }
+            return parse_char_escape(true);
+        }
+
+        if (c == '[' and (peek(1) == ':' or peek(1) == '=' or peek(1) == '.')) {
+            auto kind = peek(1);
+            if (kind != ':') {
+                return unsupported("collating element or equivalence class");
+            }
+            auto close = pattern.find(":]", pos+2);
+            if (close == std::string_view::npos) {
+                return invalid("missing ':]'");
+            }
+            auto name = pattern.substr(pos+2, close - pos - 2);
+            auto cs = posix_class(name);
+            if (not cs) {
+                return invalid("unknown character class '" + std::string(name) + "'");
+            }
+            pos = close + 2;
+            return cs;
+        }
+
+        ++pos;
+        return single_char(static_cast<unsigned char>(c));
+    }
+};
+
+} // anonymous namespace
+
+/****************************************************************************/
+regex_parse_result parse_regex(std::string_view pattern, case_type ct) {
+    regex_parser_guts guts{pattern, ct};
+    regex_parse_result retval;
+
+    auto tree = guts.parse_disjunction();
+    if (tree and not guts.eoi()) {
+        // parse_disjunction only stops early on an unmatched ')'
+        guts.invalid("unmatched ')'");
+        tree = std::nullopt;
+    }
+
+    if (tree) {
+        retval.tree = std::move(*tree);
+    } else {
+        yassert(guts.status != regex_status::ok, "regex parse failed without an error");
+    }
+    retval.status  = guts.status;
+    retval.message = guts.message;
+    retval.offset  = guts.offset;
+
+    return retval;
+}
+
+/****************************************************************************/
+std::string validate_regex(std::string_view pattern, case_type ct) {
+    auto result = parse_regex(pattern, ct);
+    if (result) {
+        return "";
+    }
+
+    //
+    // yalr doesn't understand everything std::regex does, so the final
+    // word goes to std::regex itself - built the same way the generated
+    // lexer will build it.
+    //
+    auto flags = std::regex::ECMAScript;
+    if (ct == case_type::fold) {
+        flags |= std::regex::icase;
+    }
+    try {
+        std::regex re{std::string(pattern), flags};
+    } catch (const std::regex_error& e) {
+        if (result.status == regex_status::invalid) {
+            return result.message + " at offset " + std::to_string(result.offset);
+        }
+        return e.what();
+    }
+
+    return "";
+}
+
+/****************************************************************************/
+regex_node literal_regex(std::string_view text, case_type ct) {
+    regex_node retval{regex_node_type::concat};
+
+    for (auto c : text) {
+        auto cs = single_char(static_cast<unsigned char>(c));
+        retval.children.emplace_back(ct == case_type::fold ? fold_case(cs) : cs);
+    }
+
+    if (retval.children.empty()) {
+        return regex_node{regex_node_type::empty};
+    }
+
+    return retval;
+}
+
+/****************************************************************************/
+bool nullable(const regex_node& node) {
+    switch (node.type) {
+        case regex_node_type::chars :
+            return false;
+        case regex_node_type::concat :
+            for (const auto& child : node.children) {
+                if (not nullable(child)) return false;
+            }
+            return true;
+        case regex_node_type::alternate :
+            for (const auto& child : node.children) {
+                if (nullable(child)) return true;
+            }
+            return false;
+        case regex_node_type::repeat :
+            return node.min == 0 or nullable(node.children.front());
+        default :
+            // empty, zero width assertions, and backrefs
+            // (the group may have matched nothing)
+            return true;
+    }
+}
+
+/****************************************************************************/
+char_set first_chars(const regex_node& node) {
+    char_set retval;
+
+    switch (node.type) {
+        case regex_node_type::chars :
+            retval = node.chars;
+            break;
+        case regex_node_type::concat :
+            for (const auto& child : node.children) {
+                retval |= first_chars(child);
+                if (not nullable(child)) break;
+            }
+            break;
+        case regex_node_type::alternate :
+            for (const auto& child : node.children) {
+                retval |= first_chars(child);
+            }
+            break;
+        case regex_node_type::repeat :
+            if (node.max != 0) {
+                retval = first_chars(node.children.front());
+            }
+            break;
+        case regex_node_type::backref :
+            // could be anything the group matched
+            retval.set();
+            break;
+        default :
+            // empty, assertions and lookahead consume nothing
+            break;
+    }
+
+    return retval;
+}
+
+/****************************************************************************/
+namespace {
+
+void print_chars(const char_set& cs, std::ostream& strm) {
+    strm << '[';
+    for (int c = 0; c < 256; ++c) {
+        if (not cs[c]) continue;
+        int end = c;
+        while (end < 255 and cs[end+1]) ++end;
+        auto put = [&strm](int x) {
+            if (x > 32 and x < 127) strm << char(x);
+            else strm << "\\x" << "0123456789abcdef"[x/16] << "0123456789abcdef"[x%16];
+        };
+        put(c);
+        if (end > c) { strm << '-'; put(end); }
+        c = end;
+    }
+    strm << ']';
+}
+
+void print_node(const regex_node& node, std::ostream& strm, int indent) {
+    strm << std::string(indent, ' ');
+    switch (node.type) {
+        case regex_node_type::empty :
+            strm << "empty\n";
+            break;
+        case regex_node_type::chars :
+            print_chars(node.chars, strm);
+            strm << "\n";
+            break;
+        case regex_node_type::concat :
+            strm << "concat\n";
+            break;
+        case regex_node_type::alternate :
+            strm << "alternate\n";
+            break;
+        case regex_node_type::repeat :
+            strm << "repeat {" << node.min << "," << node.max << "}"
+                << (node.lazy ? " lazy" : "") << "\n";
+            break;
+        case regex_node_type::assertion :
+            strm << "assertion " << char(node.value) << "\n";
+            break;
+        case regex_node_type::backref :
+            strm << "backref " << node.value << "\n";
+            break;
+        case regex_node_type::lookahead :
+            strm << "lookahead" << (node.negated ? " negated" : "") << "\n";
+            break;
+        default :
+            yfail("regex_node_type out of range");
+    }
+
+    for (const auto& child : node.children) {
+        print_node(child, strm, indent+2);
+    }
+}
+
+} // anonymous namespace
+
+std::ostream& pretty_print(const regex_node& node, std::ostream& strm) {
+    print_node(node, strm, 0);
+    return strm;
+}
+
+} // namespace yalr
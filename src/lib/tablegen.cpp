@@ -256,6 +256,12 @@ void compute_first_and_follow(lrtable& lt) {
         retval->productions.try_emplace(p.prod_id, p);
     }
 
+    // No parser - so no states.
+    if (not g.options.code_parser.get()) {
+        retval->success = true;
+        return retval;
+    }
+
     // new lrstates to process
     std::queue<lrstate*> q;
 
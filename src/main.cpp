@@ -5,6 +5,7 @@
 #include "codegen.hpp"
 #include "translate.hpp"
 
+#include <limits>
 #include "cxxopts.hpp"
 
 #include <iostream>
@@ -39,6 +40,10 @@ CLIOptions parse_commandline(int argc, char**argv) {
                 cxxopts::value(clopts.state_file)->implicit_value("-NONE :^-") )
             ("t,translate", "Output the grammar in another format", cxxopts::value(clopts.translate))
             ("d,debug", "Print debug information", cxxopts::value(clopts.debug))
+            ("strict-linear", "Fail if a pattern can't be matched in linear time",
+                cxxopts::value(clopts.strict_linear))
+            ("pattern-report", "Print how each pattern will be matched",
+                cxxopts::value(clopts.pattern_report))
             ;
         options.add_options("positionals")
             ("input-file", "grammar file to process",  cxxopts::value(clopts.input_file))
@@ -98,11 +103,19 @@ int main(int argc, char* argv[]) {
         std::cout << "------ PARSE TREE end ------\n";
     }
 
-    auto anatree = yalr::analyzer::analyze(tree);
+    auto anatree = yalr::analyzer::analyze(tree, clopts.strict_linear);
     if (not anatree->success) {
         anatree->errors.output(std::cerr);
         exit(1);
     }
+    if (anatree->errors.size() > 0) {
+        // just warnings
+        anatree->errors.output(std::cerr);
+    }
+
+    if (clopts.pattern_report) {
+        yalr::analyzer::pattern_report(*anatree, std::cout);
+    }
 
     if (clopts.debug) {
         std::cout << "------ ANALYZE ------\n";
@@ -326,6 +326,12 @@ TEST_CASE("match_dotted_identifier") {
         REQUIRE(lexeme);
         CHECK(lexeme->text == "foo.bar");
     }
+    SUBCASE("positive - keywords") {
+        auto p = mk_parser("lexer.parser.class");
+        auto lexeme = p.match_dotted_identifier();
+        REQUIRE(lexeme);
+        CHECK(lexeme->text == "lexer.parser.class");
+    }
     SUBCASE("negative 1 - no dot") {
         auto p = mk_parser("this_has_no_dot");
         auto lexeme = p.match_dotted_identifier();
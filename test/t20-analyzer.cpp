@@ -3,14 +3,16 @@
 #include "analyzer.hpp"
 #include "parser.hpp"
 
+#include <sstream>
+
 
 using parser = yalr::yalr_parser;
 
-auto parse_string(const std::string &s) {
+auto parse_string(const std::string &s, bool strict_linear = false) {
     auto p = parser(std::make_shared<yalr::text_source>("test", std::string{s}));
     auto tree = p.parse();
     REQUIRE(tree.success);
-    auto retval = yalr::analyzer::analyze(tree);
+    auto retval = yalr::analyzer::analyze(tree, strict_linear);
     retval->errors.output(std::cout);
 
     return retval;
@@ -38,6 +40,12 @@ TEST_CASE("No goal rule - [analyzer]") {
     CHECK(error.message == "No goal rule was declared.");
 }
 
+TEST_CASE("No goal rule needed for just a lexer - [analyzer]") {
+    auto tree = parse_string("option code.parser false; term foo 'x';");
+    CHECK(bool(*tree));
+    CHECK(tree->symbols.find("$"));
+}
+
 
 TEST_CASE("[analyzer] Error on dups") {
     SUBCASE("[analyzer] dup skip/term") {
@@ -179,3 +187,165 @@ TEST_CASE("[analyzer] Can't give void an alias") {
         // Need more tests for alias in general.
     }
 }
+
+TEST_CASE("[analyzer] @lexeme type follows lexer.lexeme") {
+    SUBCASE("[analyzer] default is std::string") {
+        auto tree = parse_string("term <@lexeme> ID r:[a-z]+ ; goal rule A { => ID ; }");
+        REQUIRE(*tree);
+        auto data_ptr = tree->symbols.find("ID")->get_data<yalr::symbol_type::terminal>();
+        REQUIRE(data_ptr);
+        CHECK(data_ptr->type_str == "std::string");
+        CHECK(data_ptr->action == "return std::move(lexeme);");
+    }
+    SUBCASE("[analyzer] view - even if the option comes later") {
+        auto tree = parse_string(R"x(
+term <@lexeme> ID r:[a-z]+ ;
+goal rule <@lexeme> A { => ID ; }
+option lexer.lexeme view;
+)x");
+        REQUIRE(*tree);
+        auto data_ptr = tree->symbols.find("ID")->get_data<yalr::symbol_type::terminal>();
+        REQUIRE(data_ptr);
+        CHECK(data_ptr->type_str == "std::string_view");
+        CHECK(data_ptr->action == "return lexeme;");
+
+        auto rule_ptr = tree->symbols.find("A")->get_data<yalr::symbol_type::rule>();
+        REQUIRE(rule_ptr);
+        CHECK(rule_ptr->type_str == "std::string_view");
+    }
+}
+
+TEST_CASE("[analyzer] numeric lexeme types") {
+    SUBCASE("[analyzer] terms are converted by the lexer") {
+        auto tree = parse_string(R"x(
+term <@int64> I r:-?\d+ ;
+term <@uint64> U r:\d+u ;
+term <@double> D r:\d+\.\d* ;
+goal rule <@double> A { => D ; }
+)x");
+        REQUIRE(*tree);
+        auto i_ptr = tree->symbols.find("I")->get_data<yalr::symbol_type::terminal>();
+        REQUIRE(i_ptr);
+        CHECK(i_ptr->type_str == "std::int64_t");
+        CHECK(i_ptr->builtin_type == "int64");
+        CHECK(i_ptr->action.empty());
+
+        auto u_ptr = tree->symbols.find("U")->get_data<yalr::symbol_type::terminal>();
+        REQUIRE(u_ptr);
+        CHECK(u_ptr->type_str == "std::uint64_t");
+
+        auto d_ptr = tree->symbols.find("D")->get_data<yalr::symbol_type::terminal>();
+        REQUIRE(d_ptr);
+        CHECK(d_ptr->type_str == "double");
+        CHECK(d_ptr->builtin_type == "double");
+
+        auto rule_ptr = tree->symbols.find("A")->get_data<yalr::symbol_type::rule>();
+        REQUIRE(rule_ptr);
+        CHECK(rule_ptr->type_str == "double");
+    }
+    SUBCASE("[analyzer] no action allowed") {
+        auto tree = parse_string("term <@int64> I r:\\d+ <%{ return 1; }%> goal rule A { => I ; }");
+        CHECK_FALSE(bool(*tree));
+    }
+}
+
+TEST_CASE("[analyzer] atom type") {
+    auto tree = parse_string("term <@atom> ID r:[a-z]+ ; goal rule <@atom> A { => ID ; }");
+    REQUIRE(*tree);
+    auto term_ptr = tree->symbols.find("ID")->get_data<yalr::symbol_type::terminal>();
+    REQUIRE(term_ptr);
+    CHECK(term_ptr->type_str == "atom");
+    CHECK(term_ptr->builtin_type == "atom");
+    CHECK(term_ptr->action.empty());
+
+    auto rule_ptr = tree->symbols.find("A")->get_data<yalr::symbol_type::rule>();
+    REQUIRE(rule_ptr);
+    CHECK(rule_ptr->type_str == "atom");
+}
+
+TEST_CASE("[analyzer] regex patterns are checked") {
+    SUBCASE("[analyzer] invalid term pattern") {
+        auto tree = parse_string("term X r:a{2,1} ; goal rule A { => X ; }");
+        CHECK_FALSE(bool(*tree));
+    }
+    SUBCASE("[analyzer] invalid skip pattern") {
+        auto tree = parse_string("skip WS r:(\\s+ ; term X 'x' ; goal rule A { => X ; }");
+        CHECK_FALSE(bool(*tree));
+    }
+    SUBCASE("[analyzer] std::regex has the final word") {
+        // yalr's own regex parser doesn't handle equivalence classes
+        auto tree = parse_string("term X r:[[=a=]]+ ; goal rule A { => X ; }");
+        CHECK(bool(*tree));
+    }
+}
+
+TEST_CASE("[analyzer] pattern costs") {
+    SUBCASE("[analyzer] hazards are warnings") {
+        // the DFA handles the first, so there is nothing to worry about
+        auto tree = parse_string(R"x(term X r:(a|ab)*c ; term Y r:(a|ab)*c\b ; goal rule A { => X ; })x");
+        CHECK(bool(*tree));
+        // the hazard and the recursion
+        CHECK(tree->errors.size() == 2);
+        CHECK(tree->errors.error_count() == 0);
+    }
+    SUBCASE("[analyzer] unbounded recursion is a warning") {
+        auto tree = parse_string(R"x(term X r:[a-z]+ ; term Y r:a*\b ; goal rule A { => X ; })x");
+        CHECK(bool(*tree));
+        CHECK(tree->errors.size() == 1);
+        CHECK(tree->errors.error_count() == 0);
+    }
+    SUBCASE("[analyzer] strict linear") {
+        auto tree = parse_string(R"x(term X r:[a-z]+ ; skip WS r:\s+ ; goal rule A { => X ; })x", true);
+        CHECK(bool(*tree));
+
+        tree = parse_string(R"x(term X r:[a-z]+ ; term Y r:\bx ; goal rule A { => X ; })x", true);
+        CHECK_FALSE(bool(*tree));
+        CHECK(tree->errors.error_count() == 1);
+    }
+    SUBCASE("[analyzer] strict linear - combined DFA too large") {
+        // Each is fine on its own, but together the DFA is too large. The
+        // later one is left to std::regex.
+        auto grammar = R"x(term AB r:[ab]*a[ab]{13} ; term CD r:[ab]*b[ab]{13} ;
+            goal rule A { => AB CD ; })x";
+        auto tree = parse_string(grammar, true);
+        CHECK_FALSE(bool(*tree));
+        CHECK(tree->errors.error_count() == 1);
+
+        tree = parse_string(grammar);
+        std::ostringstream strm;
+        yalr::analyzer::pattern_report(*tree, strm);
+        auto report = strm.str();
+        CHECK(report.find("AB                   dfa (linear)") != std::string::npos);
+        CHECK(report.find("CD                   std::regex - combined lexer DFA is too large") != std::string::npos);
+    }
+    SUBCASE("[analyzer] report - promoted keywords") {
+        // IF is looked up after ID matches, and ID is left to std::regex.
+        auto tree = parse_string(R"x(term IF 'if' ; term ID r:[a-z]+|[ab]*a[ab]{13} ;
+            term CD r:[cd]*c[cd]{13}x ; goal rule A { => IF ID CD ; })x");
+        CHECK(tree->errors.size() == 1);
+        std::ostringstream strm;
+        yalr::analyzer::pattern_report(*tree, strm);
+        auto report = strm.str();
+        CHECK(report.find("IF                   std::regex") != std::string::npos);
+        CHECK(report.find("ID                   std::regex") != std::string::npos);
+    }
+    SUBCASE("[analyzer] std::regex engine") {
+        auto tree = parse_string("option lexer.engine regex; term X 'x' ; goal rule A { => X ; }", true);
+        CHECK(bool(*tree));
+        // std::regex was asked for, so no warning for each repeat
+        tree = parse_string("option lexer.engine regex; term X r:[a-z]+ ; goal rule A { => X ; }");
+        CHECK(bool(*tree));
+        CHECK(tree->errors.size() == 0);
+        tree = parse_string("option lexer.engine regex; term X r:[a-z]+ ; goal rule A { => X ; }", true);
+        CHECK_FALSE(bool(*tree));
+    }
+    SUBCASE("[analyzer] report") {
+        auto tree = parse_string(R"x(term X r:[a-z]+ ; term Y r:(a)\1 ; goal rule A { => X ; })x");
+        std::ostringstream strm;
+        yalr::analyzer::pattern_report(*tree, strm);
+        auto report = strm.str();
+        CHECK(report.find("dfa (linear)") != std::string::npos);
+        CHECK(report.find("std::regex - ") != std::string::npos);
+        CHECK(report.find("hazard: backreference") != std::string::npos);
+    }
+}
@@ -0,0 +1,394 @@
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include "doctest.h"
+
+#include "lexgen.hpp"
+#include "regex_tree.hpp"
+
+using namespace yalr;
+
+auto regex(std::string_view p, case_type ct = case_type::match) {
+    return lexer_pattern{p, pattern_type::regex, ct};
+}
+
+auto literal(std::string_view p, case_type ct = case_type::match) {
+    return lexer_pattern{p, pattern_type::string, ct};
+}
+
+TEST_CASE("[regex] parse status") {
+    CHECK(parse_regex(R"x([a-z_][a-z0-9_]*)x", case_type::match).status == regex_status::ok);
+    CHECK(parse_regex(R"x(\d+(\.\d*)?([eE][-+]?\d+)?)x", case_type::match).status == regex_status::ok);
+    CHECK(parse_regex(R"x([[:alpha:]]+|"[^"]*")x", case_type::match).status == regex_status::ok);
+    CHECK(parse_regex(R"x(/\*(?:.|\n)*?\*/)x", case_type::match).status == regex_status::ok);
+
+    CHECK(parse_regex(R"x(\?\d{0,3))x", case_type::match).status == regex_status::invalid);
+    CHECK(parse_regex(R"x((ab)x", case_type::match).status == regex_status::invalid);
+    CHECK(parse_regex(R"x([a-z)x", case_type::match).status == regex_status::invalid);
+    CHECK(parse_regex(R"x(*a)x", case_type::match).status == regex_status::invalid);
+
+    CHECK(parse_regex(R"x([[=a=]])x", case_type::match).status == regex_status::unsupported);
+    CHECK(parse_regex(R"x(\q)x", case_type::match).status == regex_status::unsupported);
+}
+
+TEST_CASE("[lexgen] longest match and priority") {
+    auto tables = generate_lexer_tables({
+            regex(R"x(\s+)x"),
+            literal("if"),
+            literal("ifx"),
+            regex(R"x([a-z]+)x"),
+            regex(R"x(\d+)x"),
+        });
+
+    REQUIRE_FALSE(tables.dfa.empty());
+    for (const auto& f : tables.fallback) {
+        CHECK(f.empty());
+    }
+
+    const auto& dfa = tables.dfa;
+    CHECK(dfa.longest_match("if (") == std::pair<int, std::size_t>{1, 2});
+    CHECK(dfa.longest_match("ifx") == std::pair<int, std::size_t>{2, 3});
+    CHECK(dfa.longest_match("ifxy") == std::pair<int, std::size_t>{3, 4});
+    CHECK(dfa.longest_match("  \n x") == std::pair<int, std::size_t>{0, 4});
+    CHECK(dfa.longest_match("123a") == std::pair<int, std::size_t>{4, 3});
+    CHECK(dfa.longest_match("+") == std::pair<int, std::size_t>{-1, 0});
+}
+
+TEST_CASE("[lexgen] case folding") {
+    auto tables = generate_lexer_tables({
+            literal("select", case_type::fold),
+            regex(R"x([^a-c]+)x", case_type::fold),
+        });
+
+    const auto& dfa = tables.dfa;
+    CHECK(dfa.longest_match("SeLeCt") == std::pair<int, std::size_t>{0, 6});
+    CHECK(dfa.longest_match("xyzB") == std::pair<int, std::size_t>{1, 3});
+}
+
+TEST_CASE("[lexgen] counted repeats") {
+    auto tables = generate_lexer_tables({ regex(R"x(a{2,3}b?)x") });
+
+    const auto& dfa = tables.dfa;
+    CHECK(dfa.longest_match("a") == std::pair<int, std::size_t>{-1, 0});
+    CHECK(dfa.longest_match("aab") == std::pair<int, std::size_t>{0, 3});
+    CHECK(dfa.longest_match("aaaa") == std::pair<int, std::size_t>{0, 3});
+}
+
+TEST_CASE("[lexgen] fallback") {
+    auto tables = generate_lexer_tables({
+            regex(R"x(/\*(?:ab|c)*?\*/)x"),
+            regex(R"x((a)\1)x"),
+            regex(R"x(\d{0,3))x"),
+            literal("x"),
+        });
+
+    CHECK_FALSE(tables.fallback[0].empty());
+    CHECK_FALSE(tables.fallback[1].empty());
+    CHECK_FALSE(tables.fallback[2].empty());
+    CHECK(tables.fallback[3].empty());
+
+    CHECK(tables.dfa.longest_match("x") == std::pair<int, std::size_t>{3, 1});
+
+    // Only the pattern that makes the DFA too large is left out of it.
+    tables = generate_lexer_tables({
+            regex(R"x([a-z]+)x"),
+            regex(R"x([ab]*a[ab]{15})x"),
+            regex(R"x(\d+)x"),
+        });
+    CHECK(tables.fallback[0].empty());
+    CHECK_FALSE(tables.fallback[1].empty());
+    CHECK(tables.fallback[2].empty());
+    CHECK(tables.dfa.longest_match("abc") == std::pair<int, std::size_t>{0, 3});
+    CHECK(tables.dfa.longest_match("42") == std::pair<int, std::size_t>{2, 2});
+}
+
+TEST_CASE("[lexgen] minimized") {
+    // [ab]+ and (a|b)(a|b)* should collapse to the same two live states.
+    auto tables = generate_lexer_tables({ regex(R"x((a|b)(a|b)*)x") });
+
+    CHECK(tables.dfa.state_count == 3);
+    CHECK(tables.dfa.class_count == 2);
+}
+
+TEST_CASE("[lexgen] first chars") {
+    auto first = pattern_first_chars(literal("Abc", case_type::fold));
+    CHECK(first.count() == 2);
+    CHECK(first['a']);
+    CHECK(first['A']);
+
+    first = pattern_first_chars(regex(R"x(x*(-|\+)?\d)x"));
+    CHECK(first.count() == 13);
+    CHECK(first['x']);
+    CHECK(first['-']);
+    CHECK(first['7']);
+
+    first = pattern_first_chars(regex(R"x(/\*(?:.|\n)*?\*/)x"));
+    CHECK(first.count() == 1);
+    CHECK(first['/']);
+
+    // can't parse it - so anything goes
+    first = pattern_first_chars(regex(R"x(\d{0,3))x"));
+    CHECK(first.all());
+}
+
+TEST_CASE("[lexgen] skip scanners") {
+    auto skip = [](std::string_view p) {
+        return lexer_pattern{p, pattern_type::regex, case_type::match, true};
+    };
+
+    auto ws = find_skip_scanner(skip(R"x(\s+)x"));
+    REQUIRE(ws);
+    CHECK(ws->type == scanner_type::run);
+    CHECK(ws->body.count() == 6);
+
+    auto line = find_skip_scanner(skip(R"x(--.*\n)x"));
+    REQUIRE(line);
+    CHECK(line->type == scanner_type::line);
+    CHECK(line->prefix == "--");
+    CHECK(line->terminator == "\n");
+    CHECK_FALSE(line->body['\n']);
+
+    auto block = find_skip_scanner(skip(R"x(/\*(?:.|\n)*?\*/)x"));
+    REQUIRE(block);
+    CHECK(block->type == scanner_type::block);
+    CHECK(block->prefix == "/*");
+    CHECK(block->terminator == "*/");
+    CHECK(block->body['*']);
+
+    // The greedy body would eat the terminator
+    CHECK_FALSE(find_skip_scanner(skip(R"x(#.*x)x")));
+    CHECK_FALSE(find_skip_scanner(skip(R"x(\s*)x")));
+    CHECK_FALSE(find_skip_scanner(skip(R"x(/\*(?:.|\n)**/)x")));
+    CHECK_FALSE(find_skip_scanner(literal("  ")));
+
+    // Skips with scanners stay out of the DFA
+    auto tables = generate_lexer_tables({ skip(R"x(\s+)x"), literal("x") });
+    CHECK(tables.scanners[0]);
+    CHECK_FALSE(tables.scanners[1]);
+    CHECK(tables.dfa.longest_match("  x") == std::pair<int, std::size_t>{-1, 0});
+}
+
+TEST_CASE("[lexgen] delimited term scanners") {
+    auto quoted = find_skip_scanner(regex(R"x("(?:[^"\\\n]|\\.)*")x"));
+    REQUIRE(quoted);
+    CHECK(quoted->type == scanner_type::quoted);
+    CHECK(quoted->prefix == "\"");
+    CHECK(quoted->terminator == "\"");
+    CHECK(quoted->escape == '\\');
+    CHECK_FALSE(quoted->body['"']);
+    CHECK_FALSE(quoted->body['\n']);
+    CHECK(quoted->escaped['"']);
+    CHECK_FALSE(quoted->escaped['\n']);
+
+    // either order, and non-greedy with the terminator in the body
+    quoted = find_skip_scanner(regex(R"x('(\\.|.)*?')x"));
+    CHECK_FALSE(quoted);
+    quoted = find_skip_scanner(regex(R"x('(\\.|[^\\])*?')x"));
+    REQUIRE(quoted);
+    CHECK(quoted->type == scanner_type::quoted);
+
+    // The greedy body would run past the terminator
+    CHECK_FALSE(find_skip_scanner(regex(R"x("(?:[^\\]|\\.)*")x")));
+    // The escape is also in the body
+    CHECK_FALSE(find_skip_scanner(regex(R"x("(?:[^"]|\\.)*")x")));
+    // Two escapes
+    CHECK_FALSE(find_skip_scanner(regex(R"x("(?:[^"\\]|\\.|%.)*")x")));
+
+    // Delimited terms come out of the DFA (or std::regex), runs don't.
+    auto tables = generate_lexer_tables({
+            regex(R"x(/\*(?:.|\n)*?\*/)x"),
+            regex(R"x("(?:[^"\\]|\\.)*")x"),
+            regex(R"x('[^']*')x"),
+            regex(R"x([a-z]+)x"),
+        });
+    REQUIRE(tables.scanners[0]);
+    CHECK(tables.scanners[0]->type == scanner_type::block);
+    CHECK(tables.fallback[0].empty());
+    REQUIRE(tables.scanners[1]);
+    CHECK(tables.scanners[1]->type == scanner_type::quoted);
+    REQUIRE(tables.scanners[2]);
+    CHECK(tables.scanners[2]->type == scanner_type::line);
+    CHECK_FALSE(tables.scanners[3]);
+    CHECK(tables.dfa.longest_match("abc") == std::pair<int, std::size_t>{3, 3});
+}
+
+TEST_CASE("[lexgen] keyword promotion") {
+    auto promoted = find_keyword_promotions({
+            literal("if"),                          // 0 -> 4
+            literal("SELECT", case_type::fold),     // 1 -> 4
+            literal("1x"),                          // 2 - not an identifier
+            literal("x1"),                          // 3 -> 4
+            regex(R"x([a-zA-Z][a-zA-Z0-9]*)x"),     // 4
+            literal("else"),                        // 5 -> 6
+            regex(R"x([a-z]+)x"),                   // 6
+            literal("then"),                        // 7 - after the identifiers
+        });
+
+    CHECK(promoted == std::vector<int>{4, 4, -1, 4, -1, 6, -1, -1});
+
+    // A case folded keyword needs an identifier that matches every case.
+    promoted = find_keyword_promotions({
+            literal("select", case_type::fold),
+            literal("from"),
+            regex(R"x([a-z]+)x"),
+        });
+    CHECK(promoted == std::vector<int>{-1, 2, -1});
+
+    // Something in between that could match stops it.
+    promoted = find_keyword_promotions({
+            literal("for", case_type::fold),
+            regex(R"x(f[a-z])x"),
+            regex(R"x(fo[a-z])x"),
+            regex(R"x([a-zA-Z]+)x"),
+        });
+    CHECK(promoted == std::vector<int>{-1, -1, -1, -1});
+
+    // So does a term matched by a scanner, though it isn't in the DFA.
+    auto dashes = std::vector<lexer_pattern>{
+            literal("--"),
+            regex(R"x(--[a-z]*)x"),
+            regex(R"x(-+)x"),
+        };
+    promoted = find_keyword_promotions(dashes);
+    CHECK(promoted == std::vector<int>{-1, -1, -1});
+    lexer_build_options dash_options;
+    dash_options.promote_keywords = true;
+    auto dash_tables = generate_lexer_tables(dashes, dash_options);
+    CHECK(dash_tables.scanners[1]);
+    CHECK(dash_tables.dfa.longest_match("--") == std::pair<int, std::size_t>{0, 2});
+
+    auto patterns = std::vector<lexer_pattern>{
+            literal("if"), literal("then"), literal("else"),
+            literal("SELECT", case_type::fold),
+            regex(R"x([a-zA-Z]+)x"),
+        };
+    lexer_build_options options;
+    options.promote_keywords = true;
+    auto tables = generate_lexer_tables(patterns, options);
+    CHECK(tables.promoted_to == std::vector<int>{4, 4, 4, 4, -1});
+    CHECK(tables.dfa.longest_match("if") == std::pair<int, std::size_t>{4, 2});
+
+    auto table = build_keyword_table(patterns, 4, {0, 1, 2, 3});
+    REQUIRE(table.slots.size() >= 8);
+    auto mask = table.slots.size() - 1;
+    for (int k = 0; k < 4; ++k) {
+        CHECK(table.slots[keyword_hash(patterns[k].pattern, table.seed) & mask] == k);
+    }
+    CHECK(keyword_hash("SeLeCt", 7) == keyword_hash("select", 7));
+
+    // Keywords that differ only in case always hash the same, so only the
+    // first is promoted.
+    auto nulls = std::vector<lexer_pattern>{
+            literal("null"), literal("NULL"), regex(R"x([a-zA-Z_]+)x"),
+        };
+    CHECK(build_keyword_table(nulls, 2, {0, 1}).slots.empty());
+    CHECK(find_keyword_promotions(nulls) == std::vector<int>{2, -1, -1});
+    options.promote_keywords = true;
+    tables = generate_lexer_tables(nulls, options);
+    CHECK(tables.dfa.longest_match("NULL") == std::pair<int, std::size_t>{1, 4});
+    CHECK(tables.dfa.longest_match("null") == std::pair<int, std::size_t>{2, 4});
+}
+
+TEST_CASE("[lexgen] pattern cost") {
+    auto cost = [](const lexer_pattern& p,
+            lexer_engine_type e = lexer_engine_type::dfa) {
+        return analyze_pattern_cost(p, e);
+    };
+
+    CHECK(cost(regex(R"x([a-z]+)x")).engine == pattern_engine::dfa);
+    CHECK(cost(literal("if")).engine == pattern_engine::dfa);
+    CHECK(cost(regex(R"x("(?:[^"\\]|\\.)*")x")).engine == pattern_engine::scanner);
+    // a run is only a scanner for skips
+    CHECK(cost(regex(R"x(\s+)x")).engine == pattern_engine::dfa);
+
+    CHECK(cost(literal("if"), lexer_engine_type::regex).engine == pattern_engine::string);
+    auto c = cost(regex(R"x([a-z]+)x"), lexer_engine_type::regex);
+    CHECK(c.engine == pattern_engine::regex);
+    CHECK_FALSE(c.linear());
+    CHECK(c.hazards.empty());
+    CHECK(c.deep_recursion);
+
+    c = cost(regex(R"x((a)\1)x"));
+    CHECK(c.engine == pattern_engine::regex);
+    CHECK_FALSE(c.reason.empty());
+    REQUIRE(c.hazards.size() == 1);
+    CHECK(c.hazards[0].find("backreference") == 0);
+    CHECK_FALSE(c.deep_recursion);
+
+    auto hazards = [&](std::string_view p) {
+        return cost(regex(p), lexer_engine_type::regex).hazards.size();
+    };
+    CHECK(hazards(R"x((a+)+b)x") == 1);
+    CHECK(hazards(R"x((a|ab)*c)x") == 1);
+    CHECK(hazards(R"x((a|b)*c)x") == 0);
+    CHECK(hazards(R"x(\d*\d*x)x") == 1);
+    CHECK(hazards(R"x(\d*[a-z]*x)x") == 0);
+}
+
+TEST_CASE("[lexgen] lazy nfa") {
+    auto patterns = std::vector<lexer_pattern>{
+            regex(R"x(\s+)x"),
+            literal("if"),
+            literal("ifx"),
+            regex(R"x([a-z]+)x"),
+            regex(R"x(\d{2,4})x"),
+            regex(R"x([ab]*a[ab]{3})x"),
+        };
+    auto dfa_tables = generate_lexer_tables(patterns);
+    lexer_build_options lazy;
+    lazy.lazy = true;
+    auto lazy_tables = generate_lexer_tables(patterns, lazy);
+
+    CHECK(lazy_tables.dfa.empty());
+    REQUIRE_FALSE(lazy_tables.nfa.empty());
+    for (const auto& f : lazy_tables.fallback) {
+        CHECK(f.empty());
+    }
+
+    const auto& nfa = lazy_tables.nfa;
+    CHECK(nfa.eps_start.size() == nfa.set.size() + 1);
+    CHECK(nfa.set_classes.size() == std::size_t(nfa.set_count() * nfa.class_count));
+
+    for (std::string_view input : { "if (", "ifx", "ifxy", "  \n x", "12345",
+            "1", "+", "abab", "aabbb", "bbbb", "abbbbx" }) {
+        CAPTURE(input);
+        CHECK(nfa.longest_match(input) == dfa_tables.dfa.longest_match(input));
+    }
+
+    // Too big for the full DFA, but not for the NFA.
+    auto big = std::vector<lexer_pattern>{ regex(R"x([ab]*a[ab]{15})x") };
+    CHECK_FALSE(generate_lexer_tables(big).fallback[0].empty());
+    lazy_tables = generate_lexer_tables(big, lazy);
+    CHECK(lazy_tables.fallback[0].empty());
+    CHECK(lazy_tables.nfa.longest_match("bbabbbbbbbbbbbbbbbbb") == std::pair<int, std::size_t>{0, 18});
+
+    CHECK(analyze_pattern_cost(big[0], lexer_engine_type::lazy).engine == pattern_engine::lazy_dfa);
+}
+
+TEST_CASE("[lexgen] accept lists") {
+    auto patterns = std::vector<lexer_pattern>{
+            literal("from"),
+            regex(R"x([a-z]+)x"),
+            regex(R"x([a-f]+)x"),
+        };
+    lexer_build_options options;
+    options.accept_lists = true;
+    auto tables = generate_lexer_tables(patterns, options);
+    const auto& dfa = tables.dfa;
+
+    REQUIRE(dfa.accept_start.size() == std::size_t(dfa.state_count + 1));
+    auto accepts = [&](std::string_view input) {
+        int state = 1;
+        for (auto c : input) {
+            state = dfa.next_state(state, static_cast<unsigned char>(c));
+        }
+        return std::vector<int>(dfa.accept_list.begin() + dfa.accept_start[state],
+                dfa.accept_list.begin() + dfa.accept_start[state + 1]);
+    };
+
+    CHECK(accepts("from") == std::vector<int>{0, 1});
+    CHECK(accepts("fro") == std::vector<int>{1});
+    CHECK(accepts("fab") == std::vector<int>{1, 2});
+    CHECK(accepts("").empty());
+
+    // Without them, nothing extra is kept.
+    CHECK(generate_lexer_tables(patterns).dfa.accept_start.empty());
+}